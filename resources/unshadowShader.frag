@@ -1,10 +1,11 @@
 uniform sampler2D penumbraTexture;
 
-uniform float lightBrightness;
-uniform float darkBrightness;
-
+// Per vertex: the position in the penumbra texture is in the color, the light and dark brightness in the texture coordinates
 void main() {
-    float penumbra = texture2D(penumbraTexture, gl_TexCoord[0].xy).x;
+    float penumbra = texture2D(penumbraTexture, gl_Color.xy).x;
+
+    float lightBrightness = gl_TexCoord[0].x;
+    float darkBrightness = gl_TexCoord[0].y;
 	
 	float shadow = (lightBrightness - darkBrightness) * penumbra + darkBrightness;
 
@@ -1,10 +1,12 @@
 #include "Math.h"
 
 #include <list>
+#include <algorithm>
 
 #include <assert.h>
 
 #include <cmath>
+#include <limits>
 
 using namespace ltbl;
 
@@ -93,6 +95,10 @@ float ltbl::vectorDot(const sf::Vector2f &left, const sf::Vector2f &right) {
 	return left.x * right.x + left.y * right.y;
 }
 
+float ltbl::vectorCross(const sf::Vector2f &left, const sf::Vector2f &right) {
+	return left.x * right.y - left.y * right.x;
+}
+
 sf::FloatRect ltbl::rectExpand(const sf::FloatRect &rect, const sf::Vector2f &point) {
 	sf::Vector2f lowerBound = rectLowerBound(rect);
 	sf::Vector2f upperBound = rectUpperBound(rect);
@@ -110,6 +116,67 @@ sf::FloatRect ltbl::rectExpand(const sf::FloatRect &rect, const sf::Vector2f &po
 	return rectFromBounds(lowerBound, upperBound);
 }
 
+float ltbl::rectDistance(const sf::FloatRect &rect, const sf::Vector2f &point) {
+	// 0 inside
+	float dx = std::max(std::max(rect.left - point.x, point.x - (rect.left + rect.width)), 0.0f);
+	float dy = std::max(std::max(rect.top - point.y, point.y - (rect.top + rect.height)), 0.0f);
+
+	return std::sqrt(dx * dx + dy * dy);
+}
+
+sf::FloatRect ltbl::rectCombine(const sf::FloatRect &rect, const sf::FloatRect &other) {
+	sf::Vector2f lowerBound(std::min(rect.left, other.left), std::min(rect.top, other.top));
+	sf::Vector2f upperBound(std::max(rect.left + rect.width, other.left + other.width), std::max(rect.top + rect.height, other.top + other.height));
+
+	return rectFromBounds(lowerBound, upperBound);
+}
+
+float ltbl::rectPerimeter(const sf::FloatRect &rect) {
+	return 2.0f * (rect.width + rect.height);
+}
+
+OrientedRect ltbl::orientedRectFromRect(const sf::FloatRect &rect, const sf::Vector2f &center, const sf::Vector2f &direction) {
+	// Same as shapeFromRect(rect) positioned at center and rotated so its x axis points along direction
+	OrientedRect orientedRect;
+
+	orientedRect.center = center;
+	orientedRect.halfDims = rectHalfDims(rect);
+
+	orientedRect.axes[0] = vectorNormalize(direction);
+	orientedRect.axes[1] = sf::Vector2f(-orientedRect.axes[0].y, orientedRect.axes[0].x);
+
+	sf::Vector2f boundsHalfDims(orientedRect.halfDims.x * std::abs(orientedRect.axes[0].x) + orientedRect.halfDims.y * std::abs(orientedRect.axes[1].x),
+		orientedRect.halfDims.x * std::abs(orientedRect.axes[0].y) + orientedRect.halfDims.y * std::abs(orientedRect.axes[1].y));
+
+	orientedRect.bounds = rectFromBounds(center - boundsHalfDims, center + boundsHalfDims);
+
+	return orientedRect;
+}
+
+bool ltbl::orientedRectIntersection(const OrientedRect &orientedRect, const sf::FloatRect &rect) {
+	// Separating axes of the AABB (x and y), touching counts as intersecting like in shapeIntersection
+	if (rect.left > orientedRect.bounds.left + orientedRect.bounds.width || rect.left + rect.width < orientedRect.bounds.left)
+		return false;
+	if (rect.top > orientedRect.bounds.top + orientedRect.bounds.height || rect.top + rect.height < orientedRect.bounds.top)
+		return false;
+
+	// Separating axes of the oriented rectangle
+	sf::Vector2f halfDims = rectHalfDims(rect);
+	sf::Vector2f offset = rectCenter(rect) - orientedRect.center;
+
+	for (int i = 0; i < 2; i++) {
+		const sf::Vector2f &axis = orientedRect.axes[i];
+
+		float rectRadius = halfDims.x * std::abs(axis.x) + halfDims.y * std::abs(axis.y);
+		float orientedRectRadius = i == 0 ? orientedRect.halfDims.x : orientedRect.halfDims.y;
+
+		if (std::abs(vectorDot(offset, axis)) > rectRadius + orientedRectRadius)
+			return false;
+	}
+
+	return true;
+}
+
 bool ltbl::shapeIntersection(const sf::ConvexShape &left, const sf::ConvexShape &right) {
 	std::vector<sf::Vector2f> transformedLeft(left.getPointCount());
 
@@ -269,3 +336,105 @@ bool ltbl::rayIntersect(const sf::Vector2f &as, const sf::Vector2f &ad, const sf
 
 	return true;
 }
+
+bool ltbl::rayRectIntersection(const sf::FloatRect &rect, const sf::Vector2f &start, const sf::Vector2f &directionInv, float maxDistance, float &distance) {
+	// Slab test, directionInv is 1 / direction per component (may be infinite)
+	float tMin = -std::numeric_limits<float>::infinity();
+	float tMax = std::numeric_limits<float>::infinity();
+
+	// A ray parallel to a slab is never multiplied by the infinite inverse (0 * infinity is NaN on the slab planes),
+	// it is inside of it for any distance, edges included, or never
+	if (std::isinf(directionInv.x)) {
+		if (start.x < rect.left || start.x > rect.left + rect.width)
+			return false;
+	}
+	else {
+		float tx1 = (rect.left - start.x) * directionInv.x;
+		float tx2 = (rect.left + rect.width - start.x) * directionInv.x;
+
+		tMin = std::min(tx1, tx2);
+		tMax = std::max(tx1, tx2);
+	}
+
+	if (std::isinf(directionInv.y)) {
+		if (start.y < rect.top || start.y > rect.top + rect.height)
+			return false;
+	}
+	else {
+		float ty1 = (rect.top - start.y) * directionInv.y;
+		float ty2 = (rect.top + rect.height - start.y) * directionInv.y;
+
+		tMin = std::max(tMin, std::min(ty1, ty2));
+		tMax = std::min(tMax, std::max(ty1, ty2));
+	}
+
+	if (tMax < 0.0f || tMin > tMax || tMin > maxDistance)
+		return false;
+
+	distance = std::max(tMin, 0.0f);
+
+	return true;
+}
+
+bool ltbl::rayShapeIntersection(const sf::ConvexShape &shape, const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, float &distance) {
+	// direction is normalized, so distances along the ray are in world units
+	const sf::Transform &transform = shape.getTransform();
+
+	unsigned numPoints = shape.getPointCount();
+
+	if (numPoints < 3)
+		return false;
+
+	bool hit = false;
+	bool inside = true;
+
+	float closest = maxDistance;
+
+	float side = 0.0f;
+
+	sf::Vector2f point = transform.transformPoint(shape.getPoint(numPoints - 1));
+
+	for (unsigned i = 0; i < numPoints; i++) {
+		sf::Vector2f nextPoint = transform.transformPoint(shape.getPoint(i));
+
+		sf::Vector2f edge = nextPoint - point;
+		sf::Vector2f toStart = start - point;
+
+		// The start is inside if it is on the same side of every edge, whatever the winding
+		float cross = edge.x * toStart.y - edge.y * toStart.x;
+
+		if (cross != 0.0f) {
+			if (side == 0.0f)
+				side = cross;
+			else if ((side > 0.0f) != (cross > 0.0f))
+				inside = false;
+		}
+
+		// Solve start + direction * t = point + edge * s
+		float det = direction.x * edge.y - direction.y * edge.x;
+
+		if (det != 0.0f) {
+			float t = (edge.x * toStart.y - edge.y * toStart.x) / det;
+			float s = (direction.x * toStart.y - direction.y * toStart.x) / det;
+
+			if (t >= 0.0f && t <= closest && s >= 0.0f && s <= 1.0f) {
+				closest = t;
+
+				hit = true;
+			}
+		}
+
+		point = nextPoint;
+	}
+
+	if (inside) {
+		distance = 0.0f;
+
+		return true;
+	}
+
+	if (hit)
+		distance = closest;
+
+	return hit;
+}
@@ -6,6 +6,18 @@ namespace ltbl {
 	const float pi = 3.14159265f;
 	const float radToDeg = 180.0f / pi;
 
+	// Rotated rectangle with its separating axes precomputed, for intersection tests against many AABBs
+	struct OrientedRect {
+		sf::Vector2f center;
+		sf::Vector2f halfDims;
+
+		// Unit axes along the sides (x and y of the rectangle before rotation)
+		sf::Vector2f axes[2];
+
+		// Bounds (AABB) of the rotated rectangle
+		sf::FloatRect bounds;
+	};
+
 	sf::Vector2f rectCenter(const sf::FloatRect &rect);
 	bool rectContains(const sf::FloatRect &rect, const sf::FloatRect &other);
 	bool rectIntersects(const sf::FloatRect &rect, const sf::FloatRect &other);
@@ -20,9 +32,17 @@ namespace ltbl {
 	float vectorProject(const sf::Vector2f &left, const sf::Vector2f &right);
 	sf::FloatRect rectRecenter(const sf::FloatRect &rect, const sf::Vector2f &center);
 	float vectorDot(const sf::Vector2f &left, const sf::Vector2f &right);
+	float vectorCross(const sf::Vector2f &left, const sf::Vector2f &right);
 	sf::FloatRect rectExpand(const sf::FloatRect &rect, const sf::Vector2f &point);
+	float rectDistance(const sf::FloatRect &rect, const sf::Vector2f &point);
+	sf::FloatRect rectCombine(const sf::FloatRect &rect, const sf::FloatRect &other);
+	float rectPerimeter(const sf::FloatRect &rect);
+	OrientedRect orientedRectFromRect(const sf::FloatRect &rect, const sf::Vector2f &center, const sf::Vector2f &direction);
+	bool orientedRectIntersection(const OrientedRect &orientedRect, const sf::FloatRect &rect);
 	bool shapeIntersection(const sf::ConvexShape &left, const sf::ConvexShape &right);
 	sf::ConvexShape shapeFromRect(const sf::FloatRect &rect);
 	sf::ConvexShape shapeFixWinding(const sf::ConvexShape &shape);
+	bool rayRectIntersection(const sf::FloatRect &rect, const sf::Vector2f &start, const sf::Vector2f &directionInv, float maxDistance, float &distance);
+	bool rayShapeIntersection(const sf::ConvexShape &shape, const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, float &distance);
 	bool rayIntersect(const sf::Vector2f &as, const sf::Vector2f &ad, const sf::Vector2f &bs, const sf::Vector2f &bd, sf::Vector2f &intersection);
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "FacingKernel.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <assert.h>
+
+// The SIMD kernels are only built for x86-64, where SSE2 is always available and AVX is checked at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#define LTBL_FACING_KERNEL_X86
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+#define LTBL_TARGET_AVX
+#else
+#define LTBL_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+using namespace ltbl;
+
+void ShapePointsSoA::assign(const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals) {
+	const int numPoints = points.size();
+
+	pointsX.resize(numPoints + 1);
+	pointsY.resize(numPoints + 1);
+	normalsX.resize(numPoints);
+	normalsY.resize(numPoints);
+
+	for (int i = 0; i < numPoints; i++) {
+		pointsX[i] = points[i].x;
+		pointsY[i] = points[i].y;
+		normalsX[i] = normals[i].x;
+		normalsY[i] = normals[i].y;
+	}
+
+	if (numPoints > 0) {
+		pointsX[numPoints] = points[0].x;
+		pointsY[numPoints] = points[0].y;
+	}
+}
+
+namespace {
+	// All kernels do the same operations in the same order as the scalar one (which matches getPenumbrasPoint),
+	// sqrt and division are exact in SSE and AVX too, so they classify identically
+	void classifyFacingPointScalar(const ShapePointsSoA &shape, int first, int last, const sf::Vector2f &sourceCenter, float sourceRadius, unsigned char* facing) {
+		for (int i = first; i < last; i++) {
+			bool frontBoth = false;
+			bool frontOne = false;
+
+			// Point i and the next point
+			for (int j = 0; j < 2; j++) {
+				float x = shape.pointsX[i + j];
+				float y = shape.pointsY[i + j];
+
+				float offsetX = -(y - sourceCenter.y);
+				float offsetY = x - sourceCenter.x;
+
+				float magnitude = std::sqrt(offsetX * offsetX + offsetY * offsetY);
+
+				if (magnitude == 0.0f) {
+					offsetX = 1.0f;
+					offsetY = 0.0f;
+				}
+				else {
+					float magnitudeInv = 1.0f / magnitude;
+
+					offsetX = offsetX * magnitudeInv;
+					offsetY = offsetY * magnitudeInv;
+				}
+
+				offsetX *= sourceRadius;
+				offsetY *= sourceRadius;
+
+				float firstDot = (x - (sourceCenter.x - offsetX)) * shape.normalsX[i] + (y - (sourceCenter.y - offsetY)) * shape.normalsY[i];
+				float secondDot = (x - (sourceCenter.x + offsetX)) * shape.normalsX[i] + (y - (sourceCenter.y + offsetY)) * shape.normalsY[i];
+
+				frontBoth = frontBoth || (firstDot > 0.0f && secondDot > 0.0f);
+				frontOne = frontOne || firstDot > 0.0f || secondDot > 0.0f;
+			}
+
+			facing[i - first] = (frontBoth ? FacingBothEdges : 0) | (frontOne ? FacingOneEdge : 0);
+		}
+	}
+
+#ifdef LTBL_FACING_KERNEL_X86
+	// Masks of edges that face both edges and at least one edge of the source, from point i (or the next point) of 4 edges
+	void getFacingSSE(const float* pointsX, const float* pointsY, __m128 normalX, __m128 normalY, __m128 centerX, __m128 centerY, __m128 radius, __m128 &frontBoth, __m128 &frontOne) {
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 x = _mm_loadu_ps(pointsX);
+		__m128 y = _mm_loadu_ps(pointsY);
+
+		__m128 offsetX = _mm_xor_ps(_mm_sub_ps(y, centerY), _mm_set1_ps(-0.0f));
+		__m128 offsetY = _mm_sub_ps(x, centerX);
+
+		__m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(offsetX, offsetX), _mm_mul_ps(offsetY, offsetY)));
+		__m128 magnitudeInv = _mm_div_ps(_mm_set1_ps(1.0f), magnitude);
+
+		__m128 isZero = _mm_cmpeq_ps(magnitude, zero);
+
+		offsetX = _mm_or_ps(_mm_and_ps(isZero, _mm_set1_ps(1.0f)), _mm_andnot_ps(isZero, _mm_mul_ps(offsetX, magnitudeInv)));
+		offsetY = _mm_andnot_ps(isZero, _mm_mul_ps(offsetY, magnitudeInv));
+
+		offsetX = _mm_mul_ps(offsetX, radius);
+		offsetY = _mm_mul_ps(offsetY, radius);
+
+		__m128 firstDot = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, _mm_sub_ps(centerX, offsetX)), normalX), _mm_mul_ps(_mm_sub_ps(y, _mm_sub_ps(centerY, offsetY)), normalY));
+		__m128 secondDot = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, _mm_add_ps(centerX, offsetX)), normalX), _mm_mul_ps(_mm_sub_ps(y, _mm_add_ps(centerY, offsetY)), normalY));
+
+		__m128 firstFront = _mm_cmpgt_ps(firstDot, zero);
+		__m128 secondFront = _mm_cmpgt_ps(secondDot, zero);
+
+		frontBoth = _mm_or_ps(frontBoth, _mm_and_ps(firstFront, secondFront));
+		frontOne = _mm_or_ps(frontOne, _mm_or_ps(firstFront, secondFront));
+	}
+
+	void classifyFacingPointSSE(const ShapePointsSoA &shape, int first, int last, const sf::Vector2f &sourceCenter, float sourceRadius, unsigned char* facing) {
+		__m128 centerX = _mm_set1_ps(sourceCenter.x);
+		__m128 centerY = _mm_set1_ps(sourceCenter.y);
+		__m128 radius = _mm_set1_ps(sourceRadius);
+
+		int i = first;
+
+		for (; i + 4 <= last; i += 4) {
+			__m128 normalX = _mm_loadu_ps(&shape.normalsX[i]);
+			__m128 normalY = _mm_loadu_ps(&shape.normalsY[i]);
+
+			__m128 frontBoth = _mm_setzero_ps();
+			__m128 frontOne = _mm_setzero_ps();
+
+			getFacingSSE(&shape.pointsX[i], &shape.pointsY[i], normalX, normalY, centerX, centerY, radius, frontBoth, frontOne);
+			getFacingSSE(&shape.pointsX[i + 1], &shape.pointsY[i + 1], normalX, normalY, centerX, centerY, radius, frontBoth, frontOne);
+
+			int bothMask = _mm_movemask_ps(frontBoth);
+			int oneMask = _mm_movemask_ps(frontOne);
+
+			for (int j = 0; j < 4; j++)
+				facing[i - first + j] = ((bothMask >> j) & 1 ? FacingBothEdges : 0) | ((oneMask >> j) & 1 ? FacingOneEdge : 0);
+		}
+
+		classifyFacingPointScalar(shape, i, last, sourceCenter, sourceRadius, facing + (i - first));
+	}
+
+	LTBL_TARGET_AVX void getFacingAVX(const float* pointsX, const float* pointsY, __m256 normalX, __m256 normalY, __m256 centerX, __m256 centerY, __m256 radius, __m256 &frontBoth, __m256 &frontOne) {
+		const __m256 zero = _mm256_setzero_ps();
+
+		__m256 x = _mm256_loadu_ps(pointsX);
+		__m256 y = _mm256_loadu_ps(pointsY);
+
+		__m256 offsetX = _mm256_xor_ps(_mm256_sub_ps(y, centerY), _mm256_set1_ps(-0.0f));
+		__m256 offsetY = _mm256_sub_ps(x, centerX);
+
+		__m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(offsetX, offsetX), _mm256_mul_ps(offsetY, offsetY)));
+		__m256 magnitudeInv = _mm256_div_ps(_mm256_set1_ps(1.0f), magnitude);
+
+		__m256 isZero = _mm256_cmp_ps(magnitude, zero, _CMP_EQ_OQ);
+
+		offsetX = _mm256_blendv_ps(_mm256_mul_ps(offsetX, magnitudeInv), _mm256_set1_ps(1.0f), isZero);
+		offsetY = _mm256_blendv_ps(_mm256_mul_ps(offsetY, magnitudeInv), zero, isZero);
+
+		offsetX = _mm256_mul_ps(offsetX, radius);
+		offsetY = _mm256_mul_ps(offsetY, radius);
+
+		__m256 firstDot = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(x, _mm256_sub_ps(centerX, offsetX)), normalX), _mm256_mul_ps(_mm256_sub_ps(y, _mm256_sub_ps(centerY, offsetY)), normalY));
+		__m256 secondDot = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(x, _mm256_add_ps(centerX, offsetX)), normalX), _mm256_mul_ps(_mm256_sub_ps(y, _mm256_add_ps(centerY, offsetY)), normalY));
+
+		__m256 firstFront = _mm256_cmp_ps(firstDot, zero, _CMP_GT_OQ);
+		__m256 secondFront = _mm256_cmp_ps(secondDot, zero, _CMP_GT_OQ);
+
+		frontBoth = _mm256_or_ps(frontBoth, _mm256_and_ps(firstFront, secondFront));
+		frontOne = _mm256_or_ps(frontOne, _mm256_or_ps(firstFront, secondFront));
+	}
+
+	LTBL_TARGET_AVX void classifyFacingPointAVX(const ShapePointsSoA &shape, int first, int last, const sf::Vector2f &sourceCenter, float sourceRadius, unsigned char* facing) {
+		__m256 centerX = _mm256_set1_ps(sourceCenter.x);
+		__m256 centerY = _mm256_set1_ps(sourceCenter.y);
+		__m256 radius = _mm256_set1_ps(sourceRadius);
+
+		int i = first;
+
+		for (; i + 8 <= last; i += 8) {
+			__m256 normalX = _mm256_loadu_ps(&shape.normalsX[i]);
+			__m256 normalY = _mm256_loadu_ps(&shape.normalsY[i]);
+
+			__m256 frontBoth = _mm256_setzero_ps();
+			__m256 frontOne = _mm256_setzero_ps();
+
+			getFacingAVX(&shape.pointsX[i], &shape.pointsY[i], normalX, normalY, centerX, centerY, radius, frontBoth, frontOne);
+			getFacingAVX(&shape.pointsX[i + 1], &shape.pointsY[i + 1], normalX, normalY, centerX, centerY, radius, frontBoth, frontOne);
+
+			int bothMask = _mm256_movemask_ps(frontBoth);
+			int oneMask = _mm256_movemask_ps(frontOne);
+
+			for (int j = 0; j < 8; j++)
+				facing[i - first + j] = ((bothMask >> j) & 1 ? FacingBothEdges : 0) | ((oneMask >> j) & 1 ? FacingOneEdge : 0);
+		}
+
+		// Also clears the upper halves of the registers before any SSE code runs
+		_mm256_zeroupper();
+
+		classifyFacingPointSSE(shape, i, last, sourceCenter, sourceRadius, facing + (i - first));
+	}
+
+	bool isAVXSupported() {
+#ifdef _MSC_VER
+		int info[4];
+
+		__cpuid(info, 1);
+
+		// AVX, and the OS saves the AVX registers (OSXSAVE and XCR0 bits 1 and 2)
+		return (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+#else
+		__builtin_cpu_init();
+
+		return __builtin_cpu_supports("avx") != 0;
+#endif
+	}
+#endif
+
+	FacingKernelType detectFacingKernelType() {
+#ifdef LTBL_FACING_KERNEL_X86
+		return isAVXSupported() ? FacingKernelAVX : FacingKernelSSE;
+#else
+		return FacingKernelScalar;
+#endif
+	}
+
+	// Detected when first used. AVX only on request (setFacingKernelType), it measures no faster than SSE
+	// for the chunks LightSystem classifies (tests/FacingKernelBenchmark.cpp)
+	FacingKernelType &getSelectedFacingKernelType() {
+		static FacingKernelType type = std::min(detectFacingKernelType(), FacingKernelSSE);
+
+		return type;
+	}
+}
+
+FacingKernelType ltbl::getFacingKernelType() {
+	return getSelectedFacingKernelType();
+}
+
+FacingKernelType ltbl::getSupportedFacingKernelType() {
+	static FacingKernelType type = detectFacingKernelType();
+
+	return type;
+}
+
+void ltbl::setFacingKernelType(FacingKernelType type) {
+	getSelectedFacingKernelType() = std::min(type, getSupportedFacingKernelType());
+}
+
+void ltbl::classifyFacingPoint(const ShapePointsSoA &shape, int first, int last, const sf::Vector2f &sourceCenter, float sourceRadius, unsigned char* facing) {
+	assert(first >= 0 && last <= shape.getNumEdges());
+
+	switch (getSelectedFacingKernelType()) {
+#ifdef LTBL_FACING_KERNEL_X86
+	case FacingKernelAVX:
+		classifyFacingPointAVX(shape, first, last, sourceCenter, sourceRadius, facing);
+		break;
+	case FacingKernelSSE:
+		classifyFacingPointSSE(shape, first, last, sourceCenter, sourceRadius, facing);
+		break;
+#endif
+	default:
+		classifyFacingPointScalar(shape, first, last, sourceCenter, sourceRadius, facing);
+		break;
+	}
+}
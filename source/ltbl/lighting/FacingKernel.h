@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../Math.h"
+
+#include <vector>
+
+namespace ltbl {
+	// Structure of arrays copy of the world points of a shape and the normals of its edges, for the facing kernels.
+	// The point arrays repeat the first point at the end, so edge i always goes from point i to point i + 1
+	struct ShapePointsSoA {
+		std::vector<float> pointsX;
+		std::vector<float> pointsY;
+		std::vector<float> normalsX;
+		std::vector<float> normalsY;
+
+		void assign(const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals);
+
+		int getNumEdges() const {
+			return normalsX.size();
+		}
+	};
+
+	// Flags set by classifyFacingPoint
+	enum FacingFlags {
+		// Front facing as seen from both edges of the source (umbra), or from at least one of them (penumbras)
+		FacingBothEdges = 1, FacingOneEdge = 2
+	};
+
+	// Instruction sets the kernels can run with, by default SSE if the CPU supports it
+	enum FacingKernelType {
+		FacingKernelScalar, FacingKernelSSE, FacingKernelAVX
+	};
+
+	FacingKernelType getFacingKernelType();
+
+	// Widest kernel the CPU supports
+	FacingKernelType getSupportedFacingKernelType();
+
+	// Select a kernel, e.g. to compare them. Clamped to what the CPU supports
+	void setFacingKernelType(FacingKernelType type);
+
+	// Classifies edges [first, last) of a shape against a round point light, exactly like LightSystem::getPenumbrasPoint
+	// does one edge at a time. facing[i - first] receives the FacingFlags of edge i
+	void classifyFacingPoint(const ShapePointsSoA &shape, int first, int last, const sf::Vector2f &sourceCenter, float sourceRadius, unsigned char* facing);
+}
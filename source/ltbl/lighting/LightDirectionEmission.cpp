@@ -13,10 +13,14 @@ void LightDirectionEmission::render(const sf::View &view, sf::RenderTexture &lig
 
 	LightSystem::clear(lightTempTexture, sf::Color::White);
 
+	numDrawCalls = 1;
+
 	// Mask off light shape (over-masking - mask too much, reveal penumbra/antumbra afterwards)
 	for (unsigned i = 0; i < shapes.size(); i++) {
 		LightShape* pLightShape = static_cast<LightShape*>(shapes[i]);
 
+		const std::vector<sf::Vector2f> &shapePoints = pLightShape->getWorldPoints();
+
 		// Get boundaries
 		std::vector<LightSystem::Penumbra> penumbras;
 		std::vector<int> innerBoundaryIndices;
@@ -24,78 +28,69 @@ void LightDirectionEmission::render(const sf::View &view, sf::RenderTexture &lig
 		std::vector<sf::Vector2f> innerBoundaryVectors;
 		std::vector<sf::Vector2f> outerBoundaryVectors;
 
-		LightSystem::getPenumbrasDirection(penumbras, innerBoundaryIndices, innerBoundaryVectors, outerBoundaryIndices, outerBoundaryVectors, pLightShape->shape, castDirection, sourceRadius, sourceDistance);
+		LightSystem::getPenumbrasDirection(penumbras, innerBoundaryIndices, innerBoundaryVectors, outerBoundaryIndices, outerBoundaryVectors, shapePoints, pLightShape->getWorldNormals(), pLightShape->isConvex(), castDirection, sourceRadius, sourceDistance);
 
 		if (innerBoundaryIndices.size() != 2 || outerBoundaryIndices.size() != 2)
 			continue;
 
-		LightSystem::clear(antumbraTempTexture, sf::Color::White);
-
-		antumbraTempTexture.setView(view);
-
 		sf::ConvexShape maskShape;
 
 		float maxDist = 0.0f;
 
-		for (unsigned j = 0; j < pLightShape->shape.getPointCount(); j++)
-			maxDist = std::max(maxDist, vectorMagnitude(view.getCenter() - pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(j))));
+		for (unsigned j = 0; j < shapePoints.size(); j++)
+			maxDist = std::max(maxDist, vectorMagnitude(view.getCenter() - shapePoints[j]));
 
 		float totalShadowExtension = shadowExtension + maxDist;
 
 		maskShape.setPointCount(4);
 
-		maskShape.setPoint(0, pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(innerBoundaryIndices[0])));
-		maskShape.setPoint(1, pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(innerBoundaryIndices[1])));
-		maskShape.setPoint(2, pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(innerBoundaryIndices[1])) + vectorNormalize(innerBoundaryVectors[1]) * totalShadowExtension);
-		maskShape.setPoint(3, pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(innerBoundaryIndices[0])) + vectorNormalize(innerBoundaryVectors[0]) * totalShadowExtension);
+		maskShape.setPoint(0, shapePoints[innerBoundaryIndices[0]]);
+		maskShape.setPoint(1, shapePoints[innerBoundaryIndices[1]]);
+		maskShape.setPoint(2, shapePoints[innerBoundaryIndices[1]] + vectorNormalize(innerBoundaryVectors[1]) * totalShadowExtension);
+		maskShape.setPoint(3, shapePoints[innerBoundaryIndices[0]] + vectorNormalize(innerBoundaryVectors[0]) * totalShadowExtension);
 
 		maskShape.setFillColor(sf::Color::Black);
 
-		antumbraTempTexture.draw(maskShape);
+		penumbraVertices.setPrimitiveType(sf::PrimitiveType::Triangles);
+		penumbraVertices.clear();
+
+		LightSystem::addPenumbraVertices(penumbraVertices, penumbras, totalShadowExtension);
+
+		// Only the pixels the mask and penumbras cover are processed, elsewhere the antumbra texture would be white
+		sf::FloatRect shadowBounds = maskShape.getGlobalBounds();
+
+		if (penumbraVertices.getVertexCount() > 0)
+			shadowBounds = rectCombine(shadowBounds, penumbraVertices.getBounds());
+
+		sf::IntRect shadowPixels = LightSystem::getPixelBounds(antumbraTempTexture, view, shadowBounds);
+
+		if (shadowPixels.width == 0)
+			continue;
 
-		sf::VertexArray vertexArray;
+		LightSystem::clear(antumbraTempTexture, sf::Color::White, shadowPixels);
 
-		vertexArray.setPrimitiveType(sf::PrimitiveType::Triangles);
+		antumbraTempTexture.setView(view);
 
-		vertexArray.resize(3);
+		antumbraTempTexture.draw(maskShape);
 
-		{
+		// Unmask with penumbras
+		if (penumbraVertices.getVertexCount() > 0) {
 			sf::RenderStates states;
 			states.blendMode = sf::BlendAdd;
 			states.shader = &unshadowShader;
 
-			// Unmask with penumbras
-			for (unsigned j = 0; j < penumbras.size(); j++) {
-				unshadowShader.setUniform("lightBrightness", penumbras[j].lightBrightness);
-				unshadowShader.setUniform("darkBrightness", penumbras[j].darkBrightness);
+			antumbraTempTexture.draw(penumbraVertices, states);
 
-				vertexArray[0].position = penumbras[j].source;
-				vertexArray[1].position = penumbras[j].source + vectorNormalize(penumbras[j].lightEdge) * totalShadowExtension;
-				vertexArray[2].position = penumbras[j].source + vectorNormalize(penumbras[j].darkEdge) * totalShadowExtension;
-
-				vertexArray[0].texCoords = sf::Vector2f(0.0f, 1.0f);
-				vertexArray[1].texCoords = sf::Vector2f(1.0f, 0.0f);
-				vertexArray[2].texCoords = sf::Vector2f(0.0f, 0.0f);
-
-				antumbraTempTexture.draw(vertexArray, states);
-			}
+			numDrawCalls++;
 		}
 
 		antumbraTempTexture.display();
 
 		// Multiply back to lightTempTexture
-		sf::RenderStates antumbraRenderStates;
-		antumbraRenderStates.blendMode = sf::BlendMultiply;
-
-		sf::Sprite s;
+		LightSystem::multiplyRect(lightTempTexture, antumbraTempTexture.getTexture(), shadowPixels);
 
-		s.setTexture(antumbraTempTexture.getTexture());
-
-		lightTempTexture.setView(lightTempTexture.getDefaultView());
-
-		lightTempTexture.draw(s, antumbraRenderStates);
-
-		lightTempTexture.setView(view);
+		// Clear, mask and the multiply
+		numDrawCalls += 3;
 	}
 
 	for (unsigned i = 0; i < shapes.size(); i++) {
@@ -105,6 +100,8 @@ void LightDirectionEmission::render(const sf::View &view, sf::RenderTexture &lig
 			pLightShape->shape.setFillColor(sf::Color::White);
 
 			lightTempTexture.draw(pLightShape->shape);
+
+			numDrawCalls++;
 		}
 	}
 
@@ -116,5 +113,7 @@ void LightDirectionEmission::render(const sf::View &view, sf::RenderTexture &lig
 
 	lightTempTexture.draw(emissionSprite, lightRenderStates);
 
+	numDrawCalls++;
+
 	lightTempTexture.display();
 }
@@ -6,6 +6,12 @@
 namespace ltbl {
 	class LightDirectionEmission {
 	private:
+		// Penumbras of a shape, drawn at once. Kept to reuse its memory
+		sf::VertexArray penumbraVertices;
+
+		// Of the last render()
+		unsigned numDrawCalls;
+
 	public:
 		sf::Sprite emissionSprite;
 		sf::Vector2f castDirection;
@@ -14,9 +20,14 @@ namespace ltbl {
 		float sourceDistance;
 
 		LightDirectionEmission()
-			: castDirection(0.0f, 1.0f), sourceRadius(5.0f), sourceDistance(100.0f)
+			: numDrawCalls(0), castDirection(0.0f, 1.0f), sourceRadius(5.0f), sourceDistance(100.0f)
 		{}
 
+		// Draw calls (including clears) of the last render()
+		unsigned getNumDrawCalls() const {
+			return numDrawCalls;
+		}
+
 		void render(const sf::View &view, sf::RenderTexture &lightTempTexture, sf::RenderTexture &antumbraTempTexture, const std::vector<QuadtreeOccupant*> &shapes, sf::Shader &unshadowShader, float shadowExtension);
 	};
 }
\ No newline at end of file
@@ -10,8 +10,42 @@
 
 using namespace ltbl;
 
-void LightPointEmission::render(const sf::View &view, sf::RenderTexture &lightTempTexture, sf::RenderTexture &emissionTempTexture, sf::RenderTexture &antumbraTempTexture, const std::vector<QuadtreeOccupant*> &shapes, sf::Shader &unshadowShader, sf::Shader &lightOverShapeShader) {
-	LightSystem::clear(emissionTempTexture, sf::Color::Black);
+const PenumbraCacheEntry &LightPointEmission::getPenumbras(LightShape* pLightShape, const sf::Vector2f &castCenter) {
+	PenumbraCacheEntry* pEntry;
+
+	if (cachePenumbras) {
+		pEntry = &penumbraCache[pLightShape];
+
+		pEntry->used = true;
+
+		// Versions are never reused, so this also catches a new shape at the address of a removed one
+		if (pEntry->shapeVersion == pLightShape->getWorldPointsVersion() && pEntry->castCenter == castCenter && pEntry->sourceRadius == sourceRadius)
+			return *pEntry;
+	}
+	else
+		pEntry = &uncachedPenumbras;
+
+	pEntry->penumbras.clear();
+	pEntry->innerBoundaryIndices.clear();
+	pEntry->innerBoundaryVectors.clear();
+	pEntry->outerBoundaryIndices.clear();
+	pEntry->outerBoundaryVectors.clear();
+
+	LightSystem::getPenumbrasPoint(pEntry->penumbras, pEntry->innerBoundaryIndices, pEntry->innerBoundaryVectors, pEntry->outerBoundaryIndices, pEntry->outerBoundaryVectors,
+		pLightShape->getWorldPoints(), pLightShape->getWorldNormals(), pLightShape->getWorldPointsSoA(), pLightShape->isConvex(), castCenter, sourceRadius);
+
+	pEntry->shapeVersion = pLightShape->getWorldPointsVersion();
+	pEntry->castCenter = castCenter;
+	pEntry->sourceRadius = sourceRadius;
+
+	return *pEntry;
+}
+
+void LightPointEmission::render(const sf::View &view, sf::RenderTexture &lightTempTexture, sf::RenderTexture &emissionTempTexture, sf::RenderTexture &antumbraTempTexture, QuadtreeOccupant* const* shapes, size_t numShapes, sf::Shader &unshadowShader, sf::Shader &lightOverShapeShader) {
+	// The view may only cover part of the textures (see LightSystem::getSubView), only those pixels are used
+	sf::IntRect viewPixels = lightTempTexture.getViewport(view);
+
+	LightSystem::clear(emissionTempTexture, sf::Color::Black, viewPixels);
 
 	emissionTempTexture.setView(view);
 
@@ -19,12 +53,14 @@ void LightPointEmission::render(const sf::View &view, sf::RenderTexture &lightTe
 
 	emissionTempTexture.display();
 	
-	LightSystem::clear(lightTempTexture, sf::Color::Black);
+	LightSystem::clear(lightTempTexture, sf::Color::Black, viewPixels);
 
 	lightTempTexture.setView(view);
 
 	lightTempTexture.draw(emissionSprite);
 
+	numDrawCalls = 4;
+
 	sf::Transform t;
 	t.translate(emissionSprite.getPosition());
 	t.rotate(emissionSprite.getRotation());
@@ -34,171 +70,144 @@ void LightPointEmission::render(const sf::View &view, sf::RenderTexture &lightTe
 
 	float shadowExtension = shadowOverExtendMultiplier * (getAABB().width + getAABB().height);
 
-	struct OuterEdges {
-		std::vector<int> outerBoundaryIndices;
-		std::vector<sf::Vector2f> outerBoundaryVectors;
-	};
+	if (!cachePenumbras)
+		penumbraCache.clear();
 
-	std::vector<OuterEdges> outerEdges(shapes.size());
+	umbraVertices.setPrimitiveType(sf::PrimitiveType::Triangles);
+	umbraVertices.clear();
 
-	// Mask off light shape (over-masking - mask too much, reveal penumbra/antumbra afterwards)
-	for (unsigned i = 0; i < shapes.size(); i++) {
+	penumbraVertices.setPrimitiveType(sf::PrimitiveType::Triangles);
+	penumbraVertices.clear();
+
+	// Mask off light shape (over-masking - mask too much, reveal penumbra/antumbra afterwards).
+	// Everything drawn to lightTempTexture here either blackens or multiplies, so the order does not matter,
+	// and the umbras and the penumbras of all shapes are drawn together afterwards
+	for (size_t i = 0; i < numShapes; i++) {
 		LightShape* pLightShape = static_cast<LightShape*>(shapes[i]);
 
+		const std::vector<sf::Vector2f> &shapePoints = pLightShape->getWorldPoints();
+
 		// Get boundaries
-		std::vector<int> innerBoundaryIndices;
-		std::vector<sf::Vector2f> innerBoundaryVectors;
-		std::vector<LightSystem::Penumbra> penumbras;
+		const PenumbraCacheEntry &shapePenumbras = getPenumbras(pLightShape, castCenter);
 
-		LightSystem::getPenumbrasPoint(penumbras, innerBoundaryIndices, innerBoundaryVectors, outerEdges[i].outerBoundaryIndices, outerEdges[i].outerBoundaryVectors, pLightShape->shape, castCenter, sourceRadius);
+		const std::vector<int> &innerBoundaryIndices = shapePenumbras.innerBoundaryIndices;
+		const std::vector<sf::Vector2f> &innerBoundaryVectors = shapePenumbras.innerBoundaryVectors;
+		const std::vector<int> &outerBoundaryIndices = shapePenumbras.outerBoundaryIndices;
+		const std::vector<sf::Vector2f> &outerBoundaryVectors = shapePenumbras.outerBoundaryVectors;
+		const std::vector<LightSystem::Penumbra> &penumbras = shapePenumbras.penumbras;
 
-		if (innerBoundaryIndices.size() != 2 || outerEdges[i].outerBoundaryIndices.size() != 2)
+		if (innerBoundaryIndices.size() != 2 || outerBoundaryIndices.size() != 2)
 			continue;
 
-		// Render shape
-		if (!pLightShape->renderLightOverShape) {
-			pLightShape->shape.setFillColor(sf::Color::Black);
-
-			lightTempTexture.draw(pLightShape->shape);
-		}
-
-		sf::RenderStates maskRenderStates;
-		maskRenderStates.blendMode = sf::BlendNone;
-
-		sf::Vector2f as = pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(outerEdges[i].outerBoundaryIndices[0]));
-		sf::Vector2f bs = pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(outerEdges[i].outerBoundaryIndices[1]));
-		sf::Vector2f ad = outerEdges[i].outerBoundaryVectors[0];
-		sf::Vector2f bd = outerEdges[i].outerBoundaryVectors[1];
+		sf::Vector2f as = shapePoints[outerBoundaryIndices[0]];
+		sf::Vector2f bs = shapePoints[outerBoundaryIndices[1]];
+		sf::Vector2f ad = outerBoundaryVectors[0];
+		sf::Vector2f bd = outerBoundaryVectors[1];
 
 		sf::Vector2f intersectionOuter;
 
 		// Handle antumbras as a seperate case
 		if (rayIntersect(as, ad, bs, bd, intersectionOuter)) {
-			sf::Vector2f asi = pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(innerBoundaryIndices[0]));
-			sf::Vector2f bsi = pLightShape->shape.getTransform().transformPoint(pLightShape->shape.getPoint(innerBoundaryIndices[1]));
+			sf::Vector2f asi = shapePoints[innerBoundaryIndices[0]];
+			sf::Vector2f bsi = shapePoints[innerBoundaryIndices[1]];
 			sf::Vector2f adi = innerBoundaryVectors[0];
 			sf::Vector2f bdi = innerBoundaryVectors[1];
 
-			LightSystem::clear(antumbraTempTexture, sf::Color::White);
-
-			antumbraTempTexture.setView(view);
-
 			sf::Vector2f intersectionInner;
 
-			if (rayIntersect(asi, adi, bsi, bdi, intersectionInner)) {
-				sf::ConvexShape maskShape;
+			sf::ConvexShape maskShape;
 
+			if (rayIntersect(asi, adi, bsi, bdi, intersectionInner)) {
 				maskShape.setPointCount(3);
 
 				maskShape.setPoint(0, asi);
 				maskShape.setPoint(1, bsi);
 				maskShape.setPoint(2, intersectionInner);
-
-				maskShape.setFillColor(sf::Color::Black);
-
-				antumbraTempTexture.draw(maskShape);	
 			}
 			else {
-				sf::ConvexShape maskShape;
-
 				maskShape.setPointCount(4);
 
 				maskShape.setPoint(0, asi);
 				maskShape.setPoint(1, bsi);
 				maskShape.setPoint(2, bsi + vectorNormalize(bdi) * shadowExtension);
 				maskShape.setPoint(3, asi + vectorNormalize(adi) * shadowExtension);
-
-				maskShape.setFillColor(sf::Color::Black);
-
-				antumbraTempTexture.draw(maskShape);
 			}
 
-			// Add light back for antumbra/penumbras
-			sf::VertexArray vertexArray;
+			maskShape.setFillColor(sf::Color::Black);
 
-			vertexArray.setPrimitiveType(sf::PrimitiveType::Triangles);
+			antumbraPenumbraVertices.setPrimitiveType(sf::PrimitiveType::Triangles);
+			antumbraPenumbraVertices.clear();
 
-			vertexArray.resize(3);
+			LightSystem::addPenumbraVertices(antumbraPenumbraVertices, penumbras, shadowExtension);
 
-			sf::RenderStates penumbraRenderStates;
-			penumbraRenderStates.blendMode = sf::BlendAdd;
-			penumbraRenderStates.shader = &unshadowShader;
+			// Only the pixels the mask and penumbras cover are processed, elsewhere the antumbra texture would be white
+			sf::FloatRect shadowBounds = maskShape.getGlobalBounds();
 
-			// Unmask with penumbras
-			for (unsigned j = 0; j < penumbras.size(); j++) {
-				unshadowShader.setUniform("lightBrightness", penumbras[j].lightBrightness);
-				unshadowShader.setUniform("darkBrightness", penumbras[j].darkBrightness);
+			if (antumbraPenumbraVertices.getVertexCount() > 0)
+				shadowBounds = rectCombine(shadowBounds, antumbraPenumbraVertices.getBounds());
 
-				vertexArray[0].position = penumbras[j].source;
-				vertexArray[1].position = penumbras[j].source + vectorNormalize(penumbras[j].lightEdge) * shadowExtension;
-				vertexArray[2].position = penumbras[j].source + vectorNormalize(penumbras[j].darkEdge) * shadowExtension;
+			sf::IntRect shadowPixels = LightSystem::getPixelBounds(antumbraTempTexture, view, shadowBounds);
 
-				vertexArray[0].texCoords = sf::Vector2f(0.0f, 1.0f);
-				vertexArray[1].texCoords = sf::Vector2f(1.0f, 0.0f);
-				vertexArray[2].texCoords = sf::Vector2f(0.0f, 0.0f);
+			if (shadowPixels.width == 0)
+				continue;
 
-				antumbraTempTexture.draw(vertexArray, penumbraRenderStates);
-			}
+			LightSystem::clear(antumbraTempTexture, sf::Color::White, shadowPixels);
 
-			antumbraTempTexture.display();
+			antumbraTempTexture.setView(view);
 
-			// Multiply back to lightTempTexture
-			sf::RenderStates antumbraRenderStates;
-			antumbraRenderStates.blendMode = sf::BlendMultiply;
+			antumbraTempTexture.draw(maskShape);
 
-			sf::Sprite s;
+			// Add light back for antumbra/penumbras
+			if (antumbraPenumbraVertices.getVertexCount() > 0) {
+				sf::RenderStates penumbraRenderStates;
+				penumbraRenderStates.blendMode = sf::BlendAdd;
+				penumbraRenderStates.shader = &unshadowShader;
 
-			s.setTexture(antumbraTempTexture.getTexture());
+				antumbraTempTexture.draw(antumbraPenumbraVertices, penumbraRenderStates);
 
-			lightTempTexture.setView(lightTempTexture.getDefaultView());
+				numDrawCalls++;
+			}
+
+			antumbraTempTexture.display();
 
-			lightTempTexture.draw(s, antumbraRenderStates);
+			// Multiply back to lightTempTexture
+			LightSystem::multiplyRect(lightTempTexture, antumbraTempTexture.getTexture(), shadowPixels);
 
-			lightTempTexture.setView(view);
+			// Clear, mask and the multiply
+			numDrawCalls += 3;
 		}
 		else {
-			sf::ConvexShape maskShape;
-
-			maskShape.setPointCount(4);
-
-			maskShape.setPoint(0, as);
-			maskShape.setPoint(1, bs);
-			maskShape.setPoint(2, bs + vectorNormalize(bd) * shadowExtension);
-			maskShape.setPoint(3, as + vectorNormalize(ad) * shadowExtension);
+			sf::Vector2f maskPoints[4] = { as, bs, bs + vectorNormalize(bd) * shadowExtension, as + vectorNormalize(ad) * shadowExtension };
 
-			maskShape.setFillColor(sf::Color::Black);
-
-			lightTempTexture.draw(maskShape);
-
-			sf::VertexArray vertexArray;
-
-			vertexArray.setPrimitiveType(sf::PrimitiveType::Triangles);
+			// Two triangles of the quad
+			for (int j = 1; j < 3; j++) {
+				umbraVertices.append(sf::Vertex(maskPoints[0], sf::Color::Black));
+				umbraVertices.append(sf::Vertex(maskPoints[j], sf::Color::Black));
+				umbraVertices.append(sf::Vertex(maskPoints[j + 1], sf::Color::Black));
+			}
 
-			vertexArray.resize(3);
+			LightSystem::addPenumbraVertices(penumbraVertices, penumbras, shadowExtension);
+		}
+	}
 
-			sf::RenderStates penumbraRenderStates;
-			penumbraRenderStates.blendMode = sf::BlendMultiply;
-			penumbraRenderStates.shader = &unshadowShader;
+	if (umbraVertices.getVertexCount() > 0) {
+		lightTempTexture.draw(umbraVertices);
 
-			// Unmask with penumbras
-			for (unsigned j = 0; j < penumbras.size(); j++) {
-				unshadowShader.setUniform("lightBrightness", penumbras[j].lightBrightness);
-				unshadowShader.setUniform("darkBrightness", penumbras[j].darkBrightness);
+		numDrawCalls++;
+	}
 
-				vertexArray[0].position = penumbras[j].source;
-				vertexArray[1].position = penumbras[j].source + vectorNormalize(penumbras[j].lightEdge) * shadowExtension;
-				vertexArray[2].position = penumbras[j].source + vectorNormalize(penumbras[j].darkEdge) * shadowExtension;
+	// Unmask with penumbras
+	if (penumbraVertices.getVertexCount() > 0) {
+		sf::RenderStates penumbraRenderStates;
+		penumbraRenderStates.blendMode = sf::BlendMultiply;
+		penumbraRenderStates.shader = &unshadowShader;
 
-				vertexArray[0].texCoords = sf::Vector2f(0.0f, 1.0f);
-				vertexArray[1].texCoords = sf::Vector2f(1.0f, 0.0f);
-				vertexArray[2].texCoords = sf::Vector2f(0.0f, 0.0f);
+		lightTempTexture.draw(penumbraVertices, penumbraRenderStates);
 
-				lightTempTexture.draw(vertexArray, penumbraRenderStates);
-			}
-		}
+		numDrawCalls++;
 	}
 
-	for (unsigned i = 0; i < shapes.size(); i++) {
+	for (size_t i = 0; i < numShapes; i++) {
 		LightShape* pLightShape = static_cast<LightShape*>(shapes[i]);
 
 		if (pLightShape->renderLightOverShape) {
@@ -211,7 +220,20 @@ void LightPointEmission::render(const sf::View &view, sf::RenderTexture &lightTe
 
 			lightTempTexture.draw(pLightShape->shape);
 		}
+
+		numDrawCalls++;
 	}
 
 	lightTempTexture.display();
+
+	// Forget shapes that were not rendered this time, they may have been removed
+	for (std::unordered_map<const LightShape*, PenumbraCacheEntry>::iterator it = penumbraCache.begin(); it != penumbraCache.end();) {
+		if (it->second.used) {
+			it->second.used = false;
+
+			it++;
+		}
+		else
+			it = penumbraCache.erase(it);
+	}
 }
@@ -1,10 +1,31 @@
 #pragma once
 
 #include "../quadtree/QuadtreeOccupant.h"
+#include "Penumbra.h"
+
+#include <unordered_map>
 
 namespace ltbl {
 	class LightPointEmission : public QuadtreeOccupant {
 	private:
+		// Shadow geometry per shape, of the shapes rendered last time
+		std::unordered_map<const class LightShape*, PenumbraCacheEntry> penumbraCache;
+
+		// Used instead of the cache when cachePenumbras is false
+		PenumbraCacheEntry uncachedPenumbras;
+
+		// Umbras and penumbras of all shapes, each drawn at once, and the penumbras of a shape with an antumbra.
+		// Kept to reuse their memory
+		sf::VertexArray umbraVertices;
+		sf::VertexArray penumbraVertices;
+		sf::VertexArray antumbraPenumbraVertices;
+
+		// Of the last render()
+		unsigned numDrawCalls;
+
+		// Cached shadow geometry of a shape, recomputed if the shape or the cast center or source radius changed
+		const PenumbraCacheEntry &getPenumbras(class LightShape* pLightShape, const sf::Vector2f &castCenter);
+
 	public:
 		sf::Sprite emissionSprite;
 		sf::Vector2f localCastCenter;
@@ -13,14 +34,27 @@ namespace ltbl {
 
 		float shadowOverExtendMultiplier;
 
+		// Keep the shadow geometry of every shape for the next render, so static shapes lit by a static light
+		// are not recomputed. Costs memory per shape in range of the light
+		bool cachePenumbras;
+
 		LightPointEmission()
-			: localCastCenter(0.0f, 0.0f), sourceRadius(8.0f), shadowOverExtendMultiplier(1.4f)
+			: numDrawCalls(0), localCastCenter(0.0f, 0.0f), sourceRadius(8.0f), shadowOverExtendMultiplier(1.4f), cachePenumbras(true)
 		{}
 
+		void clearPenumbraCache() {
+			penumbraCache.clear();
+		}
+
+		// Draw calls (including clears) of the last render()
+		unsigned getNumDrawCalls() const {
+			return numDrawCalls;
+		}
+
 		sf::FloatRect getAABB() const {
 			return emissionSprite.getGlobalBounds();
 		}
 
-		void render(const sf::View &view, sf::RenderTexture &lightTempTexture, sf::RenderTexture &emissionTempTexture, sf::RenderTexture &antumbraTempTexture, const std::vector<QuadtreeOccupant*> &shapes, sf::Shader &unshadowShader, sf::Shader &lightOverShapeShader);
+		void render(const sf::View &view, sf::RenderTexture &lightTempTexture, sf::RenderTexture &emissionTempTexture, sf::RenderTexture &antumbraTempTexture, QuadtreeOccupant* const* shapes, size_t numShapes, sf::Shader &unshadowShader, sf::Shader &lightOverShapeShader);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "LightShape.h"
+#include "Silhouette.h"
+
+#include <atomic>
+
+using namespace ltbl;
+
+namespace {
+	std::atomic<unsigned long long> nextWorldPointsVersion(1);
+}
+
+void LightShape::updateWorldPoints() {
+	const int numPoints = shape.getPointCount();
+
+	worldPoints.resize(numPoints);
+	worldNormals.resize(numPoints);
+
+	const sf::Transform &transform = shape.getTransform();
+
+	for (int i = 0; i < numPoints; i++)
+		worldPoints[i] = transform.transformPoint(shape.getPoint(i));
+
+	for (int i = 0; i < numPoints; i++) {
+		sf::Vector2f pointToNextPoint = worldPoints[i < numPoints - 1 ? i + 1 : 0] - worldPoints[i];
+
+		worldNormals[i] = vectorNormalize(sf::Vector2f(-pointToNextPoint.y, pointToNextPoint.x));
+	}
+
+	worldPointsSoA.assign(worldPoints, worldNormals);
+
+	worldPointsConvex = isPolygonConvex(worldPoints);
+
+	worldPointsPosition = shape.getPosition();
+	worldPointsRotation = shape.getRotation();
+	worldPointsScale = shape.getScale();
+	worldPointsOrigin = shape.getOrigin();
+
+	worldPointsVersion = nextWorldPointsVersion++;
+
+	worldPointsDirty = false;
+}
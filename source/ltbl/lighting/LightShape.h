@@ -1,20 +1,104 @@
 #pragma once
 
 #include "../quadtree/QuadtreeOccupant.h"
+#include "FacingKernel.h"
+
+#include <vector>
 
 namespace ltbl {
 	class LightShape : public QuadtreeOccupant {
+	private:
+		// World space points of the shape, and the normals of its edges (from point i to point i + 1)
+		std::vector<sf::Vector2f> worldPoints;
+		std::vector<sf::Vector2f> worldNormals;
+
+		// The same in the layout of the facing kernels
+		ShapePointsSoA worldPointsSoA;
+
+		// Whether the world points form a convex polygon (no edges of length 0, all turns the same way, winding once)
+		bool worldPointsConvex;
+
+		// Transform the world points were computed with
+		sf::Vector2f worldPointsPosition;
+		float worldPointsRotation;
+		sf::Vector2f worldPointsScale;
+		sf::Vector2f worldPointsOrigin;
+
+		// Unique among all shapes, changes whenever the world points are recomputed
+		unsigned long long worldPointsVersion;
+
+		// Set when the points of the shape may have changed
+		bool worldPointsDirty;
+
+		void updateWorldPoints();
+
+	protected:
+		// The shape is added or updated (quadtreeUpdate()), which is also when its points may have changed,
+		// so the world points are recomputed after that
+		void onAABBUpdate() {
+			worldPointsDirty = true;
+		}
+
 	public:
 		bool renderLightOverShape;
 
 		sf::ConvexShape shape;
 
 		LightShape()
-			: renderLightOverShape(true)
+			: worldPointsConvex(false), worldPointsRotation(0.0f), worldPointsVersion(0), worldPointsDirty(true), renderLightOverShape(true)
 		{}
 
 		sf::FloatRect getAABB() const {
 			return shape.getGlobalBounds();
 		}
+
+		// Tests the edges of the shape
+		bool rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, float &distance) const {
+			return rayShapeIntersection(shape, start, direction, maxDistance, distance);
+		}
+
+		// Cached world space points and edge normals (normal i is the edge from point i to point i + 1 turned by (-y, x), normalized).
+		// Recomputed when the transform or the number of points of the shape changed, or after quadtreeUpdate()
+		const std::vector<sf::Vector2f> &getWorldPoints() {
+			if (isWorldPointsStale())
+				updateWorldPoints();
+
+			return worldPoints;
+		}
+
+		const std::vector<sf::Vector2f> &getWorldNormals() {
+			if (isWorldPointsStale())
+				updateWorldPoints();
+
+			return worldNormals;
+		}
+
+		const ShapePointsSoA &getWorldPointsSoA() {
+			if (isWorldPointsStale())
+				updateWorldPoints();
+
+			return worldPointsSoA;
+		}
+
+		// Changes whenever the world points do, for caches of geometry computed from them. Never reused, not even by other shapes
+		unsigned long long getWorldPointsVersion() {
+			if (isWorldPointsStale())
+				updateWorldPoints();
+
+			return worldPointsVersion;
+		}
+
+		// sf::ConvexShape does not enforce convexity. Shapes that are not convex still render, just without the faster paths
+		bool isConvex() {
+			if (isWorldPointsStale())
+				updateWorldPoints();
+
+			return worldPointsConvex;
+		}
+
+		bool isWorldPointsStale() const {
+			return worldPointsDirty || worldPoints.size() != shape.getPointCount() || worldPointsPosition != shape.getPosition() || worldPointsRotation != shape.getRotation()
+				|| worldPointsScale != shape.getScale() || worldPointsOrigin != shape.getOrigin();
+		}
 	};
-}
\ No newline at end of file
+}
@@ -1,6 +1,8 @@
 #include "LightSystem.h"
+#include "Silhouette.h"
 
 #include <cmath>
+#include <algorithm>
 
 #include <assert.h>
 
@@ -8,8 +10,67 @@
 
 using namespace ltbl;
 
-void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const sf::ConvexShape &shape, const sf::Vector2f &sourceCenter, float sourceRadius) {
-	const int numPoints = shape.getPointCount();
+namespace {
+	// Below this many points, classifying every edge is about as fast as searching for where the facing switches.
+	// Point lights classify edges with the facing kernel, which makes the scan pay off for larger shapes
+	const int minSilhouetteSearchPoints = 48;
+	const int minSilhouetteSearchPointsKernel = 192;
+
+	// Places tiles in the light atlas row by row, each row as high as its first tile (so insert the tallest tiles first)
+	struct ShelfPacker {
+		sf::Vector2i size;
+		sf::Vector2i cursor;
+		int shelfHeight;
+
+		ShelfPacker(const sf::Vector2u &size)
+			: size(size.x, size.y), cursor(0, 0), shelfHeight(0)
+		{}
+
+		void reset() {
+			cursor = sf::Vector2i(0, 0);
+			shelfHeight = 0;
+		}
+
+		// False if the atlas is full
+		bool insert(const sf::Vector2i &tileSize, sf::IntRect &tile) {
+			if (cursor.x + tileSize.x > size.x) {
+				cursor.x = 0;
+				cursor.y += shelfHeight;
+				shelfHeight = 0;
+			}
+
+			if (cursor.y + tileSize.y > size.y)
+				return false;
+
+			tile = sf::IntRect(cursor.x, cursor.y, tileSize.x, tileSize.y);
+
+			cursor.x += tileSize.x;
+			shelfHeight = std::max(shelfHeight, tileSize.y);
+
+			return true;
+		}
+	};
+
+	// Two triangles drawing texRect (of the atlas) over the pixels in target
+	void addTileVertices(sf::VertexArray &vertexArray, const sf::IntRect &target, const sf::FloatRect &texRect) {
+		sf::Vector2f lowerBound(target.left, target.top);
+		sf::Vector2f upperBound(target.left + target.width, target.top + target.height);
+
+		sf::Vector2f texLowerBound(texRect.left, texRect.top);
+		sf::Vector2f texUpperBound(texRect.left + texRect.width, texRect.top + texRect.height);
+
+		vertexArray.append(sf::Vertex(lowerBound, texLowerBound));
+		vertexArray.append(sf::Vertex(sf::Vector2f(upperBound.x, lowerBound.y), sf::Vector2f(texUpperBound.x, texLowerBound.y)));
+		vertexArray.append(sf::Vertex(upperBound, texUpperBound));
+
+		vertexArray.append(sf::Vertex(lowerBound, texLowerBound));
+		vertexArray.append(sf::Vertex(upperBound, texUpperBound));
+		vertexArray.append(sf::Vertex(sf::Vector2f(lowerBound.x, upperBound.y), sf::Vector2f(texLowerBound.x, texUpperBound.y)));
+	}
+}
+
+void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals, const ShapePointsSoA &pointsSoA, bool convex, const sf::Vector2f &sourceCenter, float sourceRadius) {
+	const int numPoints = points.size();
 
 	std::vector<bool> bothEdgesBoundaryWindings;
 	bothEdgesBoundaryWindings.reserve(2);
@@ -17,22 +78,16 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 	std::vector<bool> oneEdgeBoundaryWindings;
 	oneEdgeBoundaryWindings.reserve(2);
 
-	// Calculate front and back facing sides
-	std::vector<bool> facingFrontBothEdges;
-	facingFrontBothEdges.reserve(numPoints);
-
-	std::vector<bool> facingFrontOneEdge;
-	facingFrontOneEdge.reserve(numPoints);
-
-	for (int i = 0; i < numPoints; i++) {
-		sf::Vector2f point = shape.getTransform().transformPoint(shape.getPoint(i));
+	// Front facing edges (from point i to point i + 1), as seen from both edges of the source, or from at least one of them
+	auto getFacing = [&](int i, bool &frontBothEdges, bool &frontOneEdge) {
+		sf::Vector2f point = points[i];
 
 		sf::Vector2f nextPoint;
 
 		if (i < numPoints - 1)
-			nextPoint = shape.getTransform().transformPoint(shape.getPoint(i + 1));
+			nextPoint = points[i + 1];
 		else
-			nextPoint = shape.getTransform().transformPoint(shape.getPoint(0));
+			nextPoint = points[0];
 
 		sf::Vector2f firstEdgeRay;
 		sf::Vector2f secondEdgeRay;
@@ -63,47 +118,40 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 			secondNextEdgeRay = nextPoint - (sourceCenter + perpendicularOffset);
 		}
 
-		sf::Vector2f pointToNextPoint = nextPoint - point;
+		const sf::Vector2f &normal = normals[i];
 
-		sf::Vector2f normal = vectorNormalize(sf::Vector2f(-pointToNextPoint.y, pointToNextPoint.x));
+		frontBothEdges = (vectorDot(firstEdgeRay, normal) > 0.0f && vectorDot(secondEdgeRay, normal) > 0.0f) || (vectorDot(firstNextEdgeRay, normal) > 0.0f && vectorDot(secondNextEdgeRay, normal) > 0.0f);
+		frontOneEdge = (vectorDot(firstEdgeRay, normal) > 0.0f || vectorDot(secondEdgeRay, normal) > 0.0f) || vectorDot(firstNextEdgeRay, normal) > 0.0f || vectorDot(secondNextEdgeRay, normal) > 0.0f;
+	};
 
-		// Front facing, mark it
-		facingFrontBothEdges.push_back((vectorDot(firstEdgeRay, normal) > 0.0f && vectorDot(secondEdgeRay, normal) > 0.0f) || (vectorDot(firstNextEdgeRay, normal) > 0.0f && vectorDot(secondNextEdgeRay, normal) > 0.0f));
-		facingFrontOneEdge.push_back((vectorDot(firstEdgeRay, normal) > 0.0f || vectorDot(secondEdgeRay, normal) > 0.0f) || vectorDot(firstNextEdgeRay, normal) > 0.0f || vectorDot(secondNextEdgeRay, normal) > 0.0f);
-	}
+	// The same for many edges at once with the facing kernel, in chunks of the order the scan asks for them in
+	const int facingChunkSize = 64;
 
-	// Go through front/back facing list. Where the facing direction switches, there is a boundary
-	for (int i = 1; i < numPoints; i++)
-		if (facingFrontBothEdges[i] != facingFrontBothEdges[i - 1]) {
-			innerBoundaryIndices.push_back(i);
-			bothEdgesBoundaryWindings.push_back(facingFrontBothEdges[i]);
-		}
+	unsigned char facingChunk[facingChunkSize];
 
-	// Check looping indices separately
-	if (facingFrontBothEdges[0] != facingFrontBothEdges[numPoints - 1]) {
-		innerBoundaryIndices.push_back(0);
-		bothEdgesBoundaryWindings.push_back(facingFrontBothEdges[0]);
-	}
+	int facingChunkFirst = -facingChunkSize;
+
+	auto scanFacing = [&](int i, bool &frontBothEdges, bool &frontOneEdge) {
+		if (i < facingChunkFirst || i >= facingChunkFirst + facingChunkSize) {
+			facingChunkFirst = i;
 
-	// Go through front/back facing list. Where the facing direction switches, there is a boundary
-	for (int i = 1; i < numPoints; i++)
-		if (facingFrontOneEdge[i] != facingFrontOneEdge[i - 1]) {
-			outerBoundaryIndices.push_back(i);
-			oneEdgeBoundaryWindings.push_back(facingFrontOneEdge[i]);
+			classifyFacingPoint(pointsSoA, i, std::min(i + facingChunkSize, numPoints), sourceCenter, sourceRadius, facingChunk);
 		}
 
-	// Check looping indices separately
-	if (facingFrontOneEdge[0] != facingFrontOneEdge[numPoints - 1]) {
-		outerBoundaryIndices.push_back(0);
-		oneEdgeBoundaryWindings.push_back(facingFrontOneEdge[0]);
-	}
+		unsigned char facing = facingChunk[i - facingChunkFirst];
+
+		frontBothEdges = (facing & FacingBothEdges) != 0;
+		frontOneEdge = (facing & FacingOneEdge) != 0;
+	};
+
+	getFacingBoundaries(points, normals, convex, sourceRadius, minSilhouetteSearchPointsKernel, getFacing, scanFacing, [&](const sf::Vector2f &p) { return sourceCenter - p; }, innerBoundaryIndices, bothEdgesBoundaryWindings, outerBoundaryIndices, oneEdgeBoundaryWindings);
 
 	// Compute outer boundary vectors
 	for (unsigned bi = 0; bi < outerBoundaryIndices.size(); bi++) {
 		int penumbraIndex = outerBoundaryIndices[bi];
 		bool winding = oneEdgeBoundaryWindings[bi];
 
-		sf::Vector2f point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+		sf::Vector2f point = points[penumbraIndex];
 
 		sf::Vector2f sourceToPoint = point - sourceCenter;
 
@@ -123,7 +171,7 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 		int penumbraIndex = innerBoundaryIndices[bi];
 		bool winding = bothEdgesBoundaryWindings[bi];
 
-		sf::Vector2f point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+		sf::Vector2f point = points[penumbraIndex];
 
 		sf::Vector2f sourceToPoint = point - sourceCenter;
 
@@ -157,11 +205,11 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 
 			if (penumbraIndex < numPoints - 1) {
 				nextPointIndex = penumbraIndex + 1;
-				nextPoint = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex + 1));
+				nextPoint = points[penumbraIndex + 1];
 			}
 			else {
 				nextPointIndex = 0;
-				nextPoint = shape.getTransform().transformPoint(shape.getPoint(0));
+				nextPoint = points[0];
 			}
 
 			sf::Vector2f pointToNextPoint = nextPoint - point;
@@ -171,11 +219,11 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 
 			if (penumbraIndex > 0) {
 				prevPointIndex = penumbraIndex - 1;
-				prevPoint = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex - 1));
+				prevPoint = points[penumbraIndex - 1];
 			}
 			else {
 				prevPointIndex = numPoints - 1;
-				prevPoint = shape.getTransform().transformPoint(shape.getPoint(numPoints - 1));
+				prevPoint = points[numPoints - 1];
 			}
 
 			sf::Vector2f pointToPrevPoint = prevPoint - point;
@@ -216,7 +264,7 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 
 					prevPenumbraLightEdgeVector = penumbra.darkEdge;
 
-					point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+					point = points[penumbraIndex];
 
 					sourceToPoint = point - sourceCenter;
 
@@ -285,7 +333,7 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 
 					prevPenumbraLightEdgeVector = penumbra.darkEdge;
 
-					point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+					point = points[penumbraIndex];
 
 					sourceToPoint = point - sourceCenter;
 
@@ -330,8 +378,8 @@ void LightSystem::getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vecto
 	}
 }
 
-void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const sf::ConvexShape &shape, const sf::Vector2f &sourceDirection, float sourceRadius, float sourceDistance) {
-	const int numPoints = shape.getPointCount();
+void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals, bool convex, const sf::Vector2f &sourceDirection, float sourceRadius, float sourceDistance) {
+	const int numPoints = points.size();
 
 	innerBoundaryIndices.reserve(2);
 	innerBoundaryVectors.reserve(2);
@@ -340,75 +388,49 @@ void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::v
 	std::vector<bool> bothEdgesBoundaryWindings;
 	bothEdgesBoundaryWindings.reserve(2);
 
-	// Calculate front and back facing sides
-	std::vector<bool> facingFrontBothEdges;
-	facingFrontBothEdges.reserve(numPoints);
+	// Only the positions of the outer boundaries are needed
+	std::vector<bool> oneEdgeBoundaryWindings;
+
+	sf::Vector2f perpendicularOffset(-sourceDirection.y, sourceDirection.x);
 
-	std::vector<bool> facingFrontOneEdge;
-	facingFrontOneEdge.reserve(numPoints);
+	perpendicularOffset = vectorNormalize(perpendicularOffset);
+	perpendicularOffset *= sourceRadius;
 
-	for (int i = 0; i < numPoints; i++) {
-		sf::Vector2f point = shape.getTransform().transformPoint(shape.getPoint(i));
+	// Front facing edges (from point i to point i + 1), as seen from both edges of the source, or from at least one of them
+	auto getFacing = [&](int i, bool &frontBothEdges, bool &frontOneEdge) {
+		sf::Vector2f point = points[i];
 
 		sf::Vector2f nextPoint;
 
 		if (i < numPoints - 1)
-			nextPoint = shape.getTransform().transformPoint(shape.getPoint(i + 1));
+			nextPoint = points[i + 1];
 		else
-			nextPoint = shape.getTransform().transformPoint(shape.getPoint(0));
+			nextPoint = points[0];
 
 		sf::Vector2f firstEdgeRay;
 		sf::Vector2f secondEdgeRay;
 		sf::Vector2f firstNextEdgeRay;
 		sf::Vector2f secondNextEdgeRay;
 
-		sf::Vector2f perpendicularOffset(-sourceDirection.y, sourceDirection.x);
-
-		perpendicularOffset = vectorNormalize(perpendicularOffset);
-		perpendicularOffset *= sourceRadius;
-
 		firstEdgeRay = point - (point - sourceDirection * sourceDistance - perpendicularOffset);
 		secondEdgeRay = point - (point - sourceDirection * sourceDistance + perpendicularOffset);
 
 		firstNextEdgeRay = nextPoint - (point - sourceDirection * sourceDistance - perpendicularOffset);
 		secondNextEdgeRay = nextPoint - (point - sourceDirection * sourceDistance + perpendicularOffset);
 
-		sf::Vector2f pointToNextPoint = nextPoint - point;
+		const sf::Vector2f &normal = normals[i];
 
-		sf::Vector2f normal = vectorNormalize(sf::Vector2f(-pointToNextPoint.y, pointToNextPoint.x));
-
-		// Front facing, mark it
-		facingFrontBothEdges.push_back((vectorDot(firstEdgeRay, normal) > 0.0f && vectorDot(secondEdgeRay, normal) > 0.0f) || (vectorDot(firstNextEdgeRay, normal) > 0.0f && vectorDot(secondNextEdgeRay, normal) > 0.0f));
-		facingFrontOneEdge.push_back((vectorDot(firstEdgeRay, normal) > 0.0f || vectorDot(secondEdgeRay, normal) > 0.0f) || (vectorDot(firstNextEdgeRay, normal) > 0.0f || vectorDot(secondNextEdgeRay, normal) > 0.0f));
-	}
-
-	// Go through front/back facing list. Where the facing direction switches, there is a boundary
-	for (int i = 1; i < numPoints; i++)
-		if (facingFrontBothEdges[i] != facingFrontBothEdges[i - 1]) {
-			innerBoundaryIndices.push_back(i);
-			bothEdgesBoundaryWindings.push_back(facingFrontBothEdges[i]);
-		}
-
-	// Check looping indices separately
-	if (facingFrontBothEdges[0] != facingFrontBothEdges[numPoints - 1]) {
-		innerBoundaryIndices.push_back(0);
-		bothEdgesBoundaryWindings.push_back(facingFrontBothEdges[0]);
-	}
+		frontBothEdges = (vectorDot(firstEdgeRay, normal) > 0.0f && vectorDot(secondEdgeRay, normal) > 0.0f) || (vectorDot(firstNextEdgeRay, normal) > 0.0f && vectorDot(secondNextEdgeRay, normal) > 0.0f);
+		frontOneEdge = (vectorDot(firstEdgeRay, normal) > 0.0f || vectorDot(secondEdgeRay, normal) > 0.0f) || (vectorDot(firstNextEdgeRay, normal) > 0.0f || vectorDot(secondNextEdgeRay, normal) > 0.0f);
+	};
 
-	// Go through front/back facing list. Where the facing direction switches, there is a boundary
-	for (int i = 1; i < numPoints; i++)
-		if (facingFrontOneEdge[i] != facingFrontOneEdge[i - 1])
-			outerBoundaryIndices.push_back(i);
-
-	// Check looping indices separately
-	if (facingFrontOneEdge[0] != facingFrontOneEdge[numPoints - 1])
-		outerBoundaryIndices.push_back(0);
+	getFacingBoundaries(points, normals, convex, sourceRadius, minSilhouetteSearchPoints, getFacing, getFacing, [&](const sf::Vector2f &) { return -sourceDirection * sourceDistance; }, innerBoundaryIndices, bothEdgesBoundaryWindings, outerBoundaryIndices, oneEdgeBoundaryWindings);
 
 	for (unsigned bi = 0; bi < innerBoundaryIndices.size(); bi++) {
 		int penumbraIndex = innerBoundaryIndices[bi];
 		bool winding = bothEdgesBoundaryWindings[bi];
 
-		sf::Vector2f point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+		sf::Vector2f point = points[penumbraIndex];
 
 		sf::Vector2f perpendicularOffset(-sourceDirection.y, sourceDirection.x);
 
@@ -439,11 +461,11 @@ void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::v
 
 			if (penumbraIndex < numPoints - 1) {
 				nextPointIndex = penumbraIndex + 1;
-				nextPoint = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex + 1));
+				nextPoint = points[penumbraIndex + 1];
 			}
 			else {
 				nextPointIndex = 0;
-				nextPoint = shape.getTransform().transformPoint(shape.getPoint(0));
+				nextPoint = points[0];
 			}
 
 			sf::Vector2f pointToNextPoint = nextPoint - point;
@@ -453,11 +475,11 @@ void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::v
 
 			if (penumbraIndex > 0) {
 				prevPointIndex = penumbraIndex - 1;
-				prevPoint = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex - 1));
+				prevPoint = points[penumbraIndex - 1];
 			}
 			else {
 				prevPointIndex = numPoints - 1;
-				prevPoint = shape.getTransform().transformPoint(shape.getPoint(numPoints - 1));
+				prevPoint = points[numPoints - 1];
 			}
 
 			sf::Vector2f pointToPrevPoint = prevPoint - point;
@@ -498,7 +520,7 @@ void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::v
 
 					prevPenumbraLightEdgeVector = penumbra.darkEdge;
 
-					point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+					point = points[penumbraIndex];
 
 					perpendicularOffset = sf::Vector2f(-sourceDirection.y, sourceDirection.x);
 
@@ -555,7 +577,7 @@ void LightSystem::getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::v
 
 					prevPenumbraLightEdgeVector = penumbra.darkEdge;
 
-					point = shape.getTransform().transformPoint(shape.getPoint(penumbraIndex));
+					point = points[penumbraIndex];
 
 					perpendicularOffset = sf::Vector2f(-sourceDirection.y, sourceDirection.x);
 
@@ -597,9 +619,116 @@ void LightSystem::clear(sf::RenderTarget &rt, const sf::Color &color) {
 	rt.setView(v);
 }
 
+void LightSystem::clear(sf::RenderTarget &rt, const sf::Color &color, const sf::IntRect &rect) {
+	sf::RectangleShape shape;
+	shape.setPosition(sf::Vector2f(rect.left, rect.top));
+	shape.setSize(sf::Vector2f(rect.width, rect.height));
+	shape.setFillColor(color);
+	sf::View v = rt.getView();
+	rt.setView(rt.getDefaultView());
+	rt.draw(shape);
+	rt.setView(v);
+}
+
+sf::IntRect LightSystem::getPixelBounds(const sf::RenderTarget &rt, const sf::View &view, const sf::FloatRect &region) {
+	// Same mapping as sf::RenderTarget::mapCoordsToPixel, but clipped before converting to ints, as shadows reach far
+	sf::FloatRect viewport(rt.getViewport(view));
+
+	const sf::Transform &transform = view.getTransform();
+
+	sf::Vector2f lowerBound, upperBound;
+
+	for (int i = 0; i < 4; i++) {
+		sf::Vector2f corner(i % 2 == 0 ? region.left : region.left + region.width, i / 2 == 0 ? region.top : region.top + region.height);
+
+		sf::Vector2f normalized = transform.transformPoint(corner);
+
+		sf::Vector2f pixel((normalized.x + 1.0f) * 0.5f * viewport.width + viewport.left, (1.0f - normalized.y) * 0.5f * viewport.height + viewport.top);
+
+		if (i == 0)
+			lowerBound = upperBound = pixel;
+		else {
+			lowerBound.x = std::min(lowerBound.x, pixel.x);
+			lowerBound.y = std::min(lowerBound.y, pixel.y);
+			upperBound.x = std::max(upperBound.x, pixel.x);
+			upperBound.y = std::max(upperBound.y, pixel.y);
+		}
+	}
+
+	int left = static_cast<int>(std::max(std::floor(lowerBound.x) - 1.0f, viewport.left));
+	int top = static_cast<int>(std::max(std::floor(lowerBound.y) - 1.0f, viewport.top));
+	int right = static_cast<int>(std::min(std::ceil(upperBound.x) + 1.0f, viewport.left + viewport.width));
+	int bottom = static_cast<int>(std::min(std::ceil(upperBound.y) + 1.0f, viewport.top + viewport.height));
+
+	if (right <= left || bottom <= top)
+		return sf::IntRect(0, 0, 0, 0);
+
+	return sf::IntRect(left, top, right - left, bottom - top);
+}
+
+sf::View LightSystem::getSubView(const sf::RenderTarget &rt, const sf::View &view, const sf::IntRect &rect) {
+	sf::FloatRect viewport(rt.getViewport(view));
+
+	sf::Vector2f rectCenter(rect.left + rect.width * 0.5f, rect.top + rect.height * 0.5f);
+
+	// Inverse of the mapping in getPixelBounds
+	sf::Vector2f normalized((rectCenter.x - viewport.left) / viewport.width * 2.0f - 1.0f, 1.0f - (rectCenter.y - viewport.top) / viewport.height * 2.0f);
+
+	sf::View subView(view);
+
+	subView.setCenter(view.getInverseTransform().transformPoint(normalized));
+	subView.setSize(sf::Vector2f(view.getSize().x * rect.width / viewport.width, view.getSize().y * rect.height / viewport.height));
+	subView.setViewport(sf::FloatRect(static_cast<float>(rect.left) / rt.getSize().x, static_cast<float>(rect.top) / rt.getSize().y,
+		static_cast<float>(rect.width) / rt.getSize().x, static_cast<float>(rect.height) / rt.getSize().y));
+
+	return subView;
+}
+
+void LightSystem::multiplyRect(sf::RenderTarget &rt, const sf::Texture &texture, const sf::IntRect &rect) {
+	sf::RenderStates multiplyRenderStates;
+	multiplyRenderStates.blendMode = sf::BlendMultiply;
+
+	sf::Sprite s;
+
+	s.setTexture(texture);
+	s.setTextureRect(rect);
+	s.setPosition(sf::Vector2f(rect.left, rect.top));
+
+	sf::View v = rt.getView();
+	rt.setView(rt.getDefaultView());
+	rt.draw(s, multiplyRenderStates);
+	rt.setView(v);
+}
+
+void LightSystem::addPenumbraVertices(sf::VertexArray &vertexArray, const std::vector<Penumbra> &penumbras, float shadowExtension) {
+	for (unsigned i = 0; i < penumbras.size(); i++) {
+		sf::Vector2f brightness(penumbras[i].lightBrightness, penumbras[i].darkBrightness);
+
+		vertexArray.append(sf::Vertex(penumbras[i].source, sf::Color(0, 255, 0), brightness));
+		vertexArray.append(sf::Vertex(penumbras[i].source + vectorNormalize(penumbras[i].lightEdge) * shadowExtension, sf::Color(255, 0, 0), brightness));
+		vertexArray.append(sf::Vertex(penumbras[i].source + vectorNormalize(penumbras[i].darkEdge) * shadowExtension, sf::Color(0, 0, 0), brightness));
+	}
+}
+
+std::unique_ptr<SpatialIndex> LightSystem::createSpatialIndex(SpatialIndexType type, const sf::FloatRect &rootRegion) const {
+	if (type == DynamicAABBTreeIndex)
+		return std::unique_ptr<SpatialIndex>(new DynamicAABBTree());
+
+	if (type == SpatialHashGridIndex)
+		return std::unique_ptr<SpatialIndex>(new SpatialHashGrid(hashGridCellSize));
+
+	std::unique_ptr<DynamicQuadtree> quadtree(new DynamicQuadtree());
+
+	quadtree->oversizeMultiplier = quadtreeOversizeMultiplier;
+
+	quadtree->create(rootRegion);
+
+	return quadtree;
+}
+
 void LightSystem::create(const sf::FloatRect &rootRegion, const sf::Vector2u &imageSize, const sf::Texture &penumbraTexture, sf::Shader &unshadowShader, sf::Shader &lightOverShapeShader) {
-	shapeQuadtree.create(rootRegion);
-	lightPointEmissionQuadtree.create(rootRegion);
+	shapeQuadtree = createSpatialIndex(shapeIndexType, rootRegion);
+	lightPointEmissionQuadtree = createSpatialIndex(lightPointEmissionIndexType, rootRegion);
 
 	lightTempTexture.create(imageSize.x, imageSize.y);
 	emissionTempTexture.create(imageSize.x, imageSize.y);
@@ -618,6 +747,10 @@ void LightSystem::render(const sf::View &view, sf::Shader &unshadowShader, sf::S
 	clear(compositionTexture, ambientColor);
 	compositionTexture.setView(compositionTexture.getDefaultView());
 
+	renderStats = RenderStats();
+
+	renderStats.numDrawCalls = 1;
+
 	// Get bounding rectangle of view
 	sf::FloatRect viewBounds = sf::FloatRect(view.getCenter().x, view.getCenter().y, 0.0f, 0.0f);
 
@@ -630,27 +763,121 @@ void LightSystem::render(const sf::View &view, sf::Shader &unshadowShader, sf::S
 
 	std::vector<QuadtreeOccupant*> viewPointEmissionLights;
 
-	lightPointEmissionQuadtree.queryRegion(viewPointEmissionLights, viewBounds);
+	lightPointEmissionQuadtree->queryRegion(viewPointEmissionLights, viewBounds);
+
+	// Query the shapes all lights are affected by at once, the shapes of light l are at [shapeStarts[l], shapeStarts[l + 1])
+	std::vector<sf::FloatRect> lightRegions(viewPointEmissionLights.size());
+
+	for (unsigned l = 0; l < viewPointEmissionLights.size(); l++)
+		lightRegions[l] = static_cast<LightPointEmission*>(viewPointEmissionLights[l])->getCachedAABB();
+
+	std::vector<QuadtreeOccupant*> allLightShapes;
+	std::vector<size_t> shapeStarts;
+
+	shapeQuadtree->queryRegions(lightRegions, allLightShapes, shapeStarts);
+
+	// Only the pixels a light covers are rendered and composited, it is black everywhere else.
+	// Lights that cover none are skipped
+	std::vector<sf::IntRect> lightPixels(viewPointEmissionLights.size());
+	std::vector<unsigned> lightOrder;
 
 	for (unsigned l = 0; l < viewPointEmissionLights.size(); l++) {
+		lightPixels[l] = getPixelBounds(lightTempTexture, view, lightRegions[l]);
+
+		if (lightPixels[l].width != 0 && lightPixels[l].height != 0)
+			lightOrder.push_back(l);
+	}
+
+	bool scaledAtlas = lightAtlas && lightAtlasScale < 1.0f;
+
+	// Tiles are stretched to the footprints of their lights when they are smaller
+	lightTempTexture.setSmooth(scaledAtlas);
+
+	ShelfPacker atlasPacker(lightTempTexture.getSize());
+
+	lightAtlasVertices.clear();
+	lightAtlasVertices.setPrimitiveType(sf::PrimitiveType::Triangles);
+
+	sf::RenderStates atlasRenderStates;
+	atlasRenderStates.blendMode = sf::BlendAdd;
+	atlasRenderStates.texture = &lightTempTexture.getTexture();
+
+	if (lightAtlas) {
+		// Tallest first, so the rows of the atlas waste less space
+		std::sort(lightOrder.begin(), lightOrder.end(), [&lightPixels](unsigned a, unsigned b) { return lightPixels[a].height > lightPixels[b].height; });
+	}
+
+	for (unsigned i = 0; i < lightOrder.size(); i++) {
+		unsigned l = lightOrder[i];
+
 		LightPointEmission* pPointEmissionLight = static_cast<LightPointEmission*>(viewPointEmissionLights[l]);
 
-		// Query shapes this light is affected by
-		std::vector<QuadtreeOccupant*> lightShapes;
+		// The shapes of the light, in the results of the query of all lights
+		QuadtreeOccupant* const* lightShapes = allLightShapes.data() + shapeStarts[l];
+		size_t numLightShapes = shapeStarts[l + 1] - shapeStarts[l];
 
-		shapeQuadtree.queryRegion(lightShapes, pPointEmissionLight->getAABB());
+		sf::View lightView = getSubView(lightTempTexture, view, lightPixels[l]);
 
-		pPointEmissionLight->render(view, lightTempTexture, emissionTempTexture, antumbraTempTexture, lightShapes, unshadowShader, lightOverShapeShader);
+		if (lightAtlas) {
+			sf::Vector2i tileSize(static_cast<int>(std::ceil(lightPixels[l].width * lightAtlasScale)), static_cast<int>(std::ceil(lightPixels[l].height * lightAtlasScale)));
 
-		sf::Sprite sprite;
+			tileSize.x = std::min(std::max(tileSize.x, 1), lightPixels[l].width);
+			tileSize.y = std::min(std::max(tileSize.y, 1), lightPixels[l].height);
 
-		sprite.setTexture(lightTempTexture.getTexture());
+			sf::IntRect tile;
 
-		sf::RenderStates compoRenderStates;
-		compoRenderStates.blendMode = sf::BlendAdd;
+			if (!atlasPacker.insert(tileSize, tile)) {
+				// Atlas is full, composite the lights it holds and start over
+				compositionTexture.draw(lightAtlasVertices, atlasRenderStates);
 
-		compositionTexture.draw(sprite, compoRenderStates);
+				renderStats.numDrawCalls++;
+
+				lightAtlasVertices.clear();
+				atlasPacker.reset();
+
+				atlasPacker.insert(tileSize, tile);
+			}
+
+			// Same view, but rendering into the tile
+			lightView.setViewport(sf::FloatRect(static_cast<float>(tile.left) / lightTempTexture.getSize().x, static_cast<float>(tile.top) / lightTempTexture.getSize().y,
+				static_cast<float>(tile.width) / lightTempTexture.getSize().x, static_cast<float>(tile.height) / lightTempTexture.getSize().y));
+
+			pPointEmissionLight->render(lightView, lightTempTexture, emissionTempTexture, antumbraTempTexture, lightShapes, numLightShapes, unshadowShader, lightOverShapeShader);
+
+			// Keep filtering of scaled tiles from reading the tiles next to them
+			float inset = scaledAtlas ? 0.5f : 0.0f;
+
+			addTileVertices(lightAtlasVertices, lightPixels[l], sf::FloatRect(tile.left + inset, tile.top + inset, tile.width - inset * 2.0f, tile.height - inset * 2.0f));
+		}
+		else {
+			pPointEmissionLight->render(lightView, lightTempTexture, emissionTempTexture, antumbraTempTexture, lightShapes, numLightShapes, unshadowShader, lightOverShapeShader);
+
+			sf::Sprite sprite;
+
+			sprite.setTexture(lightTempTexture.getTexture());
+			sprite.setTextureRect(lightPixels[l]);
+			sprite.setPosition(sf::Vector2f(lightPixels[l].left, lightPixels[l].top));
+
+			sf::RenderStates compoRenderStates;
+			compoRenderStates.blendMode = sf::BlendAdd;
+
+			compositionTexture.draw(sprite, compoRenderStates);
+
+			renderStats.numDrawCalls++;
+		}
+
+		renderStats.numPointEmissionLights++;
+		renderStats.numLightShapes += numLightShapes;
+		renderStats.numDrawCalls += pPointEmissionLight->getNumDrawCalls();
 	}
+
+	if (lightAtlasVertices.getVertexCount() != 0) {
+		compositionTexture.draw(lightAtlasVertices, atlasRenderStates);
+
+		renderStats.numDrawCalls++;
+	}
+
+	std::vector<QuadtreeOccupant*> lightShapes;
 	
 	for (std::unordered_set<std::shared_ptr<LightDirectionEmission>>::iterator it = directionEmissionLights.begin(); it != directionEmissionLights.end(); it++) {
 		LightDirectionEmission* pDirectionEmissionLight = static_cast<LightDirectionEmission*>(it->get());
@@ -664,19 +891,14 @@ void LightSystem::render(const sf::View &view, sf::Shader &unshadowShader, sf::S
 
 		float shadowExtension = vectorMagnitude(rectLowerBound(centeredViewBounds)) * directionEmissionRadiusMultiplier * 2.0f;
 
-		sf::ConvexShape directionShape = shapeFromRect(extendedViewBounds);
+		// Extended view bounds centered on the view, rotated along the cast direction
+		OrientedRect directionRect = orientedRectFromRect(extendedViewBounds, view.getCenter(), pDirectionEmissionLight->castDirection);
 
-		directionShape.setPosition(view.getCenter());
+		lightShapes.clear();
 
-		sf::Vector2f normalizedCastDirection = vectorNormalize(pDirectionEmissionLight->castDirection);
+		shapeQuadtree->queryOrientedRect(lightShapes, directionRect);
 
-		directionShape.setRotation(radToDeg * std::atan2(normalizedCastDirection.y, normalizedCastDirection.x));
-
-		std::vector<QuadtreeOccupant*> viewLightShapes;
-
-		shapeQuadtree.queryShape(viewLightShapes, directionShape);
-
-		pDirectionEmissionLight->render(view, lightTempTexture, antumbraTempTexture, viewLightShapes, unshadowShader, shadowExtension);
+		pDirectionEmissionLight->render(view, lightTempTexture, antumbraTempTexture, lightShapes, unshadowShader, shadowExtension);
 
 		sf::Sprite sprite;
 
@@ -686,17 +908,34 @@ void LightSystem::render(const sf::View &view, sf::Shader &unshadowShader, sf::S
 		compoRenderStates.blendMode = sf::BlendAdd;
 
 		compositionTexture.draw(sprite, compoRenderStates);
+
+		renderStats.numDirectionEmissionLights++;
+		renderStats.numLightShapes += lightShapes.size();
+		renderStats.numDrawCalls += pDirectionEmissionLight->getNumDrawCalls() + 1;
 	}
 
 	compositionTexture.display();
 }
 
 void LightSystem::addShape(const std::shared_ptr<LightShape> &lightShape) {
-	shapeQuadtree.add(lightShape.get());
+	shapeQuadtree->add(lightShape.get());
 
 	lightShapes.insert(lightShape);
 }
 
+void LightSystem::addShapes(const std::vector<std::shared_ptr<LightShape>> &shapes) {
+	std::vector<QuadtreeOccupant*> occupants;
+
+	occupants.reserve(shapes.size());
+
+	for (std::vector<std::shared_ptr<LightShape>>::const_iterator it = shapes.begin(); it != shapes.end(); it++)
+		occupants.push_back(it->get());
+
+	shapeQuadtree->bulkAdd(occupants);
+
+	lightShapes.insert(shapes.begin(), shapes.end());
+}
+
 void LightSystem::removeShape(const std::shared_ptr<LightShape> &lightShape) {
 	std::unordered_set<std::shared_ptr<LightShape>>::iterator it = lightShapes.find(lightShape);
 
@@ -708,7 +947,7 @@ void LightSystem::removeShape(const std::shared_ptr<LightShape> &lightShape) {
 }
 
 void LightSystem::addLight(const std::shared_ptr<LightPointEmission> &pointEmissionLight) {
-	lightPointEmissionQuadtree.add(pointEmissionLight.get());
+	lightPointEmissionQuadtree->add(pointEmissionLight.get());
 
 	pointEmissionLights.insert(pointEmissionLight);
 }
@@ -727,6 +966,24 @@ void LightSystem::removeLight(const std::shared_ptr<LightPointEmission> &pointEm
 	}
 }
 
+void LightSystem::getNearestLights(const sf::Vector2f &p, size_t k, std::vector<LightPointEmission*> &lights) {
+	std::vector<NearestHit> hits;
+
+	lightPointEmissionQuadtree->queryNearest(p, k, hits);
+
+	for (unsigned i = 0; i < hits.size(); i++)
+		lights.push_back(static_cast<LightPointEmission*>(hits[i].pOccupant));
+}
+
+void LightSystem::getLightsInRadius(const sf::Vector2f &p, float radius, std::vector<LightPointEmission*> &lights) {
+	std::vector<NearestHit> hits;
+
+	lightPointEmissionQuadtree->queryRadius(p, radius, hits);
+
+	for (unsigned i = 0; i < hits.size(); i++)
+		lights.push_back(static_cast<LightPointEmission*>(hits[i].pOccupant));
+}
+
 void LightSystem::removeLight(const std::shared_ptr<LightDirectionEmission> &directionEmissionLight) {
 	std::unordered_set<std::shared_ptr<LightDirectionEmission>>::iterator it = directionEmissionLights.find(directionEmissionLight);
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "../quadtree/DynamicQuadtree.h"
+#include "../quadtree/DynamicAABBTree.h"
+#include "../quadtree/SpatialHashGrid.h"
 #include "LightPointEmission.h"
 #include "LightDirectionEmission.h"
 #include "LightShape.h"
@@ -10,39 +12,99 @@
 namespace ltbl {
 	class LightSystem : sf::NonCopyable {
 	public:
-		struct Penumbra {
-			sf::Vector2f source;
-			sf::Vector2f lightEdge;
-			sf::Vector2f darkEdge;
-			float lightBrightness;
-			float darkBrightness;
-
-			float distance;
+		// Containers that can be used for shapes and point lights
+		enum SpatialIndexType {
+			DynamicQuadtreeIndex, DynamicAABBTreeIndex, SpatialHashGridIndex
 		};
 
+		// Counts of the last render()
+		struct RenderStats {
+			unsigned numPointEmissionLights;
+			unsigned numDirectionEmissionLights;
+
+			// Shapes summed over the lights
+			unsigned numLightShapes;
+
+			// Including clears and compositing the lights
+			unsigned numDrawCalls;
+
+			RenderStats()
+				: numPointEmissionLights(0), numDirectionEmissionLights(0), numLightShapes(0), numDrawCalls(0)
+			{}
+		};
+
+		// Also available as LightSystem::Penumbra
+		typedef ltbl::Penumbra Penumbra;
+
 	private:
 		sf::RenderTexture lightTempTexture, emissionTempTexture, antumbraTempTexture, compositionTexture;
 
-		static void getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const sf::ConvexShape &shape, const sf::Vector2f &sourceCenter, float sourceRadius);
-		static void getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const sf::ConvexShape &shape, const sf::Vector2f &sourceDirection, float sourceRadius, float sourceDistance);
+		static void getPenumbrasPoint(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals, const ShapePointsSoA &pointsSoA, bool convex, const sf::Vector2f &sourceCenter, float sourceRadius);
+		static void getPenumbrasDirection(std::vector<Penumbra> &penumbras, std::vector<int> &innerBoundaryIndices, std::vector<sf::Vector2f> &innerBoundaryVectors, std::vector<int> &outerBoundaryIndices, std::vector<sf::Vector2f> &outerBoundaryVectors, const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals, bool convex, const sf::Vector2f &sourceDirection, float sourceRadius, float sourceDistance);
 
 		static void clear(sf::RenderTarget &rt, const sf::Color &color);
+
+		// Only the pixels in rect
+		static void clear(sf::RenderTarget &rt, const sf::Color &color, const sf::IntRect &rect);
+
+		// Pixels of rt covered by region (in the coordinates of view), with a pixel of margin, clipped to the viewport of view
+		static sf::IntRect getPixelBounds(const sf::RenderTarget &rt, const sf::View &view, const sf::FloatRect &region);
+
+		// View that maps the same as view, but only to the pixels in rect (of rt), so everything drawn with it is clipped to them
+		static sf::View getSubView(const sf::RenderTarget &rt, const sf::View &view, const sf::IntRect &rect);
+
+		// Multiplies the pixels of rt in rect with the same pixels of texture (of the same size as rt)
+		static void multiplyRect(sf::RenderTarget &rt, const sf::Texture &texture, const sf::IntRect &rect);
+
+		// Appends the triangles of penumbras for the unshadow shader, with the light and dark brightness in the
+		// texture coordinates and the position in the penumbra texture in the color of every vertex
+		static void addPenumbraVertices(sf::VertexArray &vertexArray, const std::vector<Penumbra> &penumbras, float shadowExtension);
 		
-		DynamicQuadtree shapeQuadtree;
-		DynamicQuadtree lightPointEmissionQuadtree;
+		// Empty quadtrees until create()
+		std::unique_ptr<SpatialIndex> shapeQuadtree;
+		std::unique_ptr<SpatialIndex> lightPointEmissionQuadtree;
+
+		std::unique_ptr<SpatialIndex> createSpatialIndex(SpatialIndexType type, const sf::FloatRect &rootRegion) const;
 
 		std::unordered_set<std::shared_ptr<LightPointEmission>> pointEmissionLights;
 		std::unordered_set<std::shared_ptr<LightDirectionEmission>> directionEmissionLights;
 		std::unordered_set<std::shared_ptr<LightShape>> lightShapes;
 
+		RenderStats renderStats;
+
+		// Tiles of the light atlas, composited at once
+		sf::VertexArray lightAtlasVertices;
+
 	public:
 		float directionEmissionRange;
 		float directionEmissionRadiusMultiplier;
 		sf::Color ambientColor;
 
+		// Looseness of the shape and light quadtrees (see Quadtree::oversizeMultiplier), applied in create()
+		float quadtreeOversizeMultiplier;
+
+		// Containers used for shapes and point lights, applied in create()
+		SpatialIndexType shapeIndexType;
+		SpatialIndexType lightPointEmissionIndexType;
+
+		// Cell size used when either of the above is SpatialHashGridIndex, about the size of a tile
+		float hashGridCellSize;
+
+		// Render the point lights into tiles of one atlas (the light render textures), sized to their footprint on screen,
+		// and composite all tiles in one draw. The atlas is composited early and reused when the tiles do not fit
+		bool lightAtlas;
+
+		// Resolution of the atlas tiles relative to the screen, below 1 trades sharpness of shadows for fill rate
+		float lightAtlasScale;
+
 		LightSystem()
-			: directionEmissionRange(10000.0f), directionEmissionRadiusMultiplier(1.1f), ambientColor(sf::Color(16, 16, 16))
-		{}
+			: directionEmissionRange(10000.0f), directionEmissionRadiusMultiplier(1.1f), ambientColor(sf::Color(16, 16, 16)), quadtreeOversizeMultiplier(1.0f),
+			shapeIndexType(DynamicQuadtreeIndex), lightPointEmissionIndexType(DynamicQuadtreeIndex), hashGridCellSize(64.0f),
+			lightAtlas(false), lightAtlasScale(1.0f)
+		{
+			shapeQuadtree.reset(new DynamicQuadtree());
+			lightPointEmissionQuadtree.reset(new DynamicQuadtree());
+		}
 
 		void create(const sf::FloatRect &rootRegion, const sf::Vector2u &imageSize, const sf::Texture &penumbraTexture, sf::Shader &unshadowShader, sf::Shader &lightOverShapeShader);
 
@@ -50,6 +112,9 @@ namespace ltbl {
 
 		void addShape(const std::shared_ptr<LightShape> &lightShape);
 
+		// Adds many shapes at once, much faster than addShape() on an empty quadtree (see Quadtree::bulkAdd)
+		void addShapes(const std::vector<std::shared_ptr<LightShape>> &shapes);
+
 		void removeShape(const std::shared_ptr<LightShape> &lightShape);
 	
 		void addLight(const std::shared_ptr<LightPointEmission> &pointEmissionLight);
@@ -58,12 +123,58 @@ namespace ltbl {
 		void removeLight(const std::shared_ptr<LightPointEmission> &pointEmissionLight);
 		void removeLight(const std::shared_ptr<LightDirectionEmission> &directionEmissionLight);
 
+		// The containers of the shapes and point lights, of the type selected with shapeIndexType and
+		// lightPointEmissionIndexType. For introspection, e.g. Quadtree::getStats and Quadtree::countQueries
+		SpatialIndex* getShapeIndex() const {
+			return shapeQuadtree.get();
+		}
+
+		SpatialIndex* getLightPointEmissionIndex() const {
+			return lightPointEmissionQuadtree.get();
+		}
+
 		void trimLightPointEmissionQuadtree() {
-			lightPointEmissionQuadtree.trim();
+			lightPointEmissionQuadtree->trim();
 		}
 
 		void trimShapeQuadtree() {
-			shapeQuadtree.trim();
+			shapeQuadtree->trim();
+		}
+
+		// Defers quadtreeUpdate() calls of shapes and point lights until commitUpdateBatch(), see Quadtree::beginBatch
+		void beginUpdateBatch() {
+			shapeQuadtree->beginBatch();
+			lightPointEmissionQuadtree->beginBatch();
+		}
+
+		void commitUpdateBatch() {
+			shapeQuadtree->commitBatch();
+			lightPointEmissionQuadtree->commitBatch();
+		}
+
+		// The (up to) k point lights closest to p, and all point lights within radius of p, sorted by distance
+		void getNearestLights(const sf::Vector2f &p, size_t k, std::vector<LightPointEmission*> &lights);
+		void getLightsInRadius(const sf::Vector2f &p, float radius, std::vector<LightPointEmission*> &lights);
+
+		// Ray and segment casts against the shapes, see SpatialIndex::rayCast. Hits are LightShapes
+		bool rayCastShapes(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit) {
+			return shapeQuadtree->rayCast(start, direction, maxDistance, hit);
+		}
+
+		void rayCastAllShapes(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits) {
+			shapeQuadtree->rayCastAll(start, direction, maxDistance, hits);
+		}
+
+		bool segmentCastShapes(const sf::Vector2f &start, const sf::Vector2f &end, RayCastHit &hit) {
+			return shapeQuadtree->segmentCast(start, end, hit);
+		}
+
+		void segmentCastAllShapes(const sf::Vector2f &start, const sf::Vector2f &end, std::vector<RayCastHit> &hits) {
+			shapeQuadtree->segmentCastAll(start, end, hits);
+		}
+
+		const RenderStats &getRenderStats() const {
+			return renderStats;
 		}
 
 		const sf::Texture &getLightingTexture() const {
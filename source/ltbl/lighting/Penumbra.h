@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../Math.h"
+
+#include <vector>
+
+namespace ltbl {
+	struct Penumbra {
+		sf::Vector2f source;
+		sf::Vector2f lightEdge;
+		sf::Vector2f darkEdge;
+		float lightBrightness;
+		float darkBrightness;
+
+		float distance;
+	};
+
+	// Shadow geometry of a shape as seen from a point light (see LightSystem::getPenumbrasPoint), and what it was computed from
+	struct PenumbraCacheEntry {
+		std::vector<Penumbra> penumbras;
+		std::vector<int> innerBoundaryIndices;
+		std::vector<sf::Vector2f> innerBoundaryVectors;
+		std::vector<int> outerBoundaryIndices;
+		std::vector<sf::Vector2f> outerBoundaryVectors;
+
+		// LightShape::getWorldPointsVersion() of the shape, and the cast center and source radius of the light
+		unsigned long long shapeVersion;
+		sf::Vector2f castCenter;
+		float sourceRadius;
+
+		// Whether it was used in the last render of the light, those that were not are removed after it
+		bool used;
+
+		PenumbraCacheEntry()
+			: shapeVersion(0), sourceRadius(0.0f), used(false)
+		{}
+	};
+}
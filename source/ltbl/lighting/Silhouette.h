@@ -0,0 +1,251 @@
+#pragma once
+
+#include "../Math.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <assert.h>
+
+namespace ltbl {
+	// Convex if all turns are the same way (or straight), and the edges only change direction twice along each axis,
+	// which rules out polygons that wind more than once
+	inline bool isPolygonConvex(const std::vector<sf::Vector2f> &points) {
+		const int numPoints = points.size();
+
+		if (numPoints < 3)
+			return false;
+
+		float turnSign = 0.0f;
+
+		int xSignChanges = 0;
+		int ySignChanges = 0;
+
+		sf::Vector2f prevEdge = points[0] - points[numPoints - 1];
+
+		float prevSignX = prevEdge.x;
+		float prevSignY = prevEdge.y;
+
+		for (int i = 0; i < numPoints; i++) {
+			sf::Vector2f edge = points[i < numPoints - 1 ? i + 1 : 0] - points[i];
+
+			if (edge.x == 0.0f && edge.y == 0.0f)
+				return false;
+
+			float turn = vectorCross(prevEdge, edge);
+
+			if (turn != 0.0f) {
+				if (turn * turnSign < 0.0f)
+					return false;
+
+				turnSign = turn;
+			}
+
+			if (edge.x != 0.0f) {
+				if (edge.x * prevSignX < 0.0f)
+					xSignChanges++;
+
+				prevSignX = edge.x;
+			}
+
+			if (edge.y != 0.0f) {
+				if (edge.y * prevSignY < 0.0f)
+					ySignChanges++;
+
+				prevSignY = edge.y;
+			}
+
+			prevEdge = edge;
+		}
+
+		return turnSign != 0.0f && xSignChanges <= 2 && ySignChanges <= 2;
+	}
+
+	// Index of the edge (from point i to point i + 1) of a convex polygon that a ray from origin, inside of it, leaves
+	// through. Angles of the points around origin from the first point, times windingSign, increase along the ring
+	inline int findExitEdge(const std::vector<sf::Vector2f> &points, const sf::Vector2f &origin, const sf::Vector2f &direction, float windingSign) {
+		sf::Vector2f firstOffset = points[0] - origin;
+
+		auto getAngle = [&](const sf::Vector2f &offset) {
+			float angle = std::atan2(windingSign * vectorCross(firstOffset, offset), vectorDot(firstOffset, offset));
+
+			return angle < 0.0f ? angle + 2.0f * pi : angle;
+		};
+
+		float directionAngle = getAngle(direction);
+
+		// Last point at or before the direction. The first point is at 0, closing the ring is at 2 pi
+		int lower = 0;
+		int upper = points.size();
+
+		while (upper - lower > 1) {
+			int middle = (lower + upper) / 2;
+
+			if (getAngle(points[middle] - origin) <= directionAngle)
+				lower = middle;
+			else
+				upper = middle;
+		}
+
+		return lower;
+	}
+
+	// First edge that does not face, going from edge first (which faces) to edge last (which does not) in steps of step
+	template<class IsFacing>
+	int findFacingSwitch(int numPoints, int first, int last, int step, IsFacing isFacing) {
+		int lower = 0;
+		int upper = ((last - first) * step % numPoints + numPoints) % numPoints;
+
+		while (upper - lower > 1) {
+			int middle = (lower + upper) / 2;
+
+			if (isFacing(((first + middle * step) % numPoints + numPoints) % numPoints))
+				lower = middle;
+			else
+				upper = middle;
+		}
+
+		return ((first + upper * step) % numPoints + numPoints) % numPoints;
+	}
+
+	// Binary searches both ways from frontEdge to backEdge for the points where the facing switches. Only valid if the
+	// front facing edges form one run, which they do for convex shapes and a source outside of them
+	template<class IsFacing>
+	bool searchFacingBoundaries(int numPoints, int frontEdge, int backEdge, IsFacing isFacing, std::vector<int> &boundaryIndices, std::vector<bool> &boundaryWindings) {
+		if (frontEdge == backEdge || !isFacing(frontEdge) || isFacing(backEdge))
+			return false;
+
+		// Edges switch to back facing going forward, and to front facing going backward
+		int backIndex = findFacingSwitch(numPoints, frontEdge, backEdge, 1, isFacing);
+		int frontIndex = (findFacingSwitch(numPoints, frontEdge, backEdge, -1, isFacing) + 1) % numPoints;
+
+		// Same order as scanFacingBoundaries
+		bool frontFirst = (frontIndex == 0 ? numPoints : frontIndex) < (backIndex == 0 ? numPoints : backIndex);
+
+		boundaryIndices.push_back(frontFirst ? frontIndex : backIndex);
+		boundaryWindings.push_back(frontFirst);
+
+		boundaryIndices.push_back(frontFirst ? backIndex : frontIndex);
+		boundaryWindings.push_back(!frontFirst);
+
+		return true;
+	}
+
+	// Classifies every edge. Boundaries are the points where the facing of the edges switches, with whether the edge
+	// starting there faces front (the winding), in index order with point 0 last
+	template<class GetFacing>
+	void scanFacingBoundaries(int numPoints, GetFacing getFacing, std::vector<int> &bothEdgesIndices, std::vector<bool> &bothEdgesWindings, std::vector<int> &oneEdgeIndices, std::vector<bool> &oneEdgeWindings) {
+		bool firstFrontBothEdges, firstFrontOneEdge;
+
+		getFacing(0, firstFrontBothEdges, firstFrontOneEdge);
+
+		bool prevFrontBothEdges = firstFrontBothEdges;
+		bool prevFrontOneEdge = firstFrontOneEdge;
+
+		for (int i = 1; i < numPoints; i++) {
+			bool frontBothEdges, frontOneEdge;
+
+			getFacing(i, frontBothEdges, frontOneEdge);
+
+			if (frontBothEdges != prevFrontBothEdges) {
+				bothEdgesIndices.push_back(i);
+				bothEdgesWindings.push_back(frontBothEdges);
+			}
+
+			if (frontOneEdge != prevFrontOneEdge) {
+				oneEdgeIndices.push_back(i);
+				oneEdgeWindings.push_back(frontOneEdge);
+			}
+
+			prevFrontBothEdges = frontBothEdges;
+			prevFrontOneEdge = frontOneEdge;
+		}
+
+		// Check looping indices separately
+		if (firstFrontBothEdges != prevFrontBothEdges) {
+			bothEdgesIndices.push_back(0);
+			bothEdgesWindings.push_back(firstFrontBothEdges);
+		}
+
+		if (firstFrontOneEdge != prevFrontOneEdge) {
+			oneEdgeIndices.push_back(0);
+			oneEdgeWindings.push_back(firstFrontOneEdge);
+		}
+	}
+
+	// Whether searched boundaries are the same as those of scanFacingBoundaries, wherever the scan finds one run
+	template<class GetFacing>
+	bool matchesScan(int numPoints, GetFacing getFacing, const std::vector<int> &bothEdgesIndices, const std::vector<int> &oneEdgeIndices) {
+		std::vector<int> scanBothEdgesIndices, scanOneEdgeIndices;
+		std::vector<bool> scanBothEdgesWindings, scanOneEdgeWindings;
+
+		scanFacingBoundaries(numPoints, getFacing, scanBothEdgesIndices, scanBothEdgesWindings, scanOneEdgeIndices, scanOneEdgeWindings);
+
+		return (scanBothEdgesIndices.size() != 2 || std::equal(scanBothEdgesIndices.begin(), scanBothEdgesIndices.end(), bothEdgesIndices.end() - 2))
+			&& (scanOneEdgeIndices.size() != 2 || std::equal(scanOneEdgeIndices.begin(), scanOneEdgeIndices.end(), oneEdgeIndices.end() - 2));
+	}
+
+	// Silhouette of a (convex) shape, the boundaries of the edges facing the source from both of its edges (the umbra)
+	// and from at least one (the penumbras), see scanFacingBoundaries. getFacing(i, frontBothEdges, frontOneEdge)
+	// classifies edge i, scanFacing does the same for the scan, which asks for the edges in order.
+	// getSourceDirection(p) is the offset from p to the center of the source.
+	// Convex shapes of at least minSearchPoints points are binary searched, in O(log n). If that does not apply (the source
+	// is inside or touches the shape, ...), and for small shapes or shapes that are not convex, all edges are classified
+	template<class GetFacing, class ScanFacing, class GetSourceDirection>
+	void getFacingBoundaries(const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals, bool convex, float sourceRadius, int minSearchPoints, GetFacing getFacing, ScanFacing scanFacing, GetSourceDirection getSourceDirection, std::vector<int> &bothEdgesIndices, std::vector<bool> &bothEdgesWindings, std::vector<int> &oneEdgeIndices, std::vector<bool> &oneEdgeWindings) {
+		const int numPoints = points.size();
+
+		if (convex && numPoints >= minSearchPoints) {
+			// Inside the shape if it is convex
+			sf::Vector2f origin = (points[0] + points[numPoints / 3] + points[2 * numPoints / 3]) / 3.0f;
+
+			float winding = vectorCross(points[0] - origin, points[1] - origin);
+
+			if (winding != 0.0f) {
+				float windingSign = winding > 0.0f ? 1.0f : -1.0f;
+
+				// The edge the ray from the origin towards the source leaves through faces it, the one on the other side does not
+				sf::Vector2f sourceDirection = getSourceDirection(origin);
+
+				int frontEdge = findExitEdge(points, origin, sourceDirection, windingSign);
+				int backEdge = findExitEdge(points, origin, -sourceDirection, windingSign);
+
+				// The facing edges are only one run if the source is outside of the shape, which it is if it is
+				// entirely past the line of the edge facing it
+				bool separated = vectorDot(getSourceDirection(points[frontEdge]), normals[frontEdge]) * windingSign < -sourceRadius;
+
+				auto isFacingBothEdges = [&](int i) {
+					bool frontBothEdges, frontOneEdge;
+
+					getFacing(i, frontBothEdges, frontOneEdge);
+
+					return frontBothEdges;
+				};
+
+				auto isFacingOneEdge = [&](int i) {
+					bool frontBothEdges, frontOneEdge;
+
+					getFacing(i, frontBothEdges, frontOneEdge);
+
+					return frontOneEdge;
+				};
+
+				size_t bothEdgesFirst = bothEdgesIndices.size();
+
+				if (separated && searchFacingBoundaries(numPoints, frontEdge, backEdge, isFacingBothEdges, bothEdgesIndices, bothEdgesWindings)) {
+					if (searchFacingBoundaries(numPoints, frontEdge, backEdge, isFacingOneEdge, oneEdgeIndices, oneEdgeWindings)) {
+						assert(matchesScan(numPoints, getFacing, bothEdgesIndices, oneEdgeIndices));
+
+						return;
+					}
+
+					bothEdgesIndices.resize(bothEdgesFirst);
+					bothEdgesWindings.resize(bothEdgesFirst);
+				}
+			}
+		}
+
+		scanFacingBoundaries(numPoints, scanFacing, bothEdgesIndices, bothEdgesWindings, oneEdgeIndices, oneEdgeWindings);
+	}
+}
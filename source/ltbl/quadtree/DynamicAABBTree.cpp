@@ -0,0 +1,544 @@
+#include "DynamicAABBTree.h"
+
+#include <algorithm>
+
+#include <assert.h>
+
+using namespace ltbl;
+
+int DynamicAABBTree::allocateNode() {
+	int index;
+
+	// Reuse a free node if possible
+	if (freeList != -1) {
+		index = freeList;
+		freeList = nodes[index].parent;
+	}
+	else {
+		index = nodes.size();
+		nodes.push_back(Node());
+	}
+
+	Node &node = nodes[index];
+
+	node.pOccupant = nullptr;
+	node.parent = -1;
+	node.child1 = -1;
+	node.child2 = -1;
+	node.height = 0;
+
+	return index;
+}
+
+void DynamicAABBTree::freeNode(int index) {
+	nodes[index].parent = freeList;
+	nodes[index].pOccupant = nullptr;
+	nodes[index].height = -1;
+
+	freeList = index;
+}
+
+sf::FloatRect DynamicAABBTree::getFatAABB(const sf::FloatRect &aabb) const {
+	return sf::FloatRect(aabb.left - margin, aabb.top - margin, aabb.width + 2.0f * margin, aabb.height + 2.0f * margin);
+}
+
+void DynamicAABBTree::insertLeaf(int leaf) {
+	if (root == -1) {
+		root = leaf;
+		nodes[root].parent = -1;
+
+		return;
+	}
+
+	// Find the best sibling for the new leaf
+	sf::FloatRect leafAABB = nodes[leaf].aabb;
+
+	int index = root;
+
+	while (!nodes[index].isLeaf()) {
+		const Node &node = nodes[index];
+
+		float perimeter = rectPerimeter(node.aabb);
+		float combinedPerimeter = rectPerimeter(rectCombine(node.aabb, leafAABB));
+
+		// Cost of creating a new parent for this node and the new leaf
+		float cost = 2.0f * combinedPerimeter;
+
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedPerimeter - perimeter);
+
+		// Cost of descending into either child
+		float childCosts[2];
+		int children[2] = { node.child1, node.child2 };
+
+		for (int i = 0; i < 2; i++) {
+			const Node &child = nodes[children[i]];
+
+			if (child.isLeaf())
+				childCosts[i] = rectPerimeter(rectCombine(child.aabb, leafAABB)) + inheritanceCost;
+			else
+				childCosts[i] = rectPerimeter(rectCombine(child.aabb, leafAABB)) - rectPerimeter(child.aabb) + inheritanceCost;
+		}
+
+		// Stop if creating a parent here is cheapest
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	int sibling = index;
+
+	// Create a new parent for the sibling and the leaf
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].aabb = rectCombine(leafAABB, nodes[sibling].aabb);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != -1) {
+		if (nodes[oldParent].child1 == sibling)
+			nodes[oldParent].child1 = newParent;
+		else
+			nodes[oldParent].child2 = newParent;
+	}
+	else
+		root = newParent;
+
+	// Walk back up, fixing heights and AABBs
+	index = nodes[leaf].parent;
+
+	while (index != -1) {
+		index = balance(index);
+
+		Node &node = nodes[index];
+
+		node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+		node.aabb = rectCombine(nodes[node.child1].aabb, nodes[node.child2].aabb);
+
+		index = node.parent;
+	}
+}
+
+void DynamicAABBTree::removeLeaf(int leaf) {
+	if (leaf == root) {
+		root = -1;
+
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	freeNode(parent);
+
+	if (grandParent == -1) {
+		root = sibling;
+		nodes[sibling].parent = -1;
+
+		return;
+	}
+
+	// Connect the sibling to the grand parent in place of the parent
+	if (nodes[grandParent].child1 == parent)
+		nodes[grandParent].child1 = sibling;
+	else
+		nodes[grandParent].child2 = sibling;
+
+	nodes[sibling].parent = grandParent;
+
+	// Walk back up, fixing heights and AABBs
+	int index = grandParent;
+
+	while (index != -1) {
+		index = balance(index);
+
+		Node &node = nodes[index];
+
+		node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+		node.aabb = rectCombine(nodes[node.child1].aabb, nodes[node.child2].aabb);
+
+		index = node.parent;
+	}
+}
+
+int DynamicAABBTree::balance(int iA) {
+	Node &a = nodes[iA];
+
+	if (a.isLeaf() || a.height < 2)
+		return iA;
+
+	int iB = a.child1;
+	int iC = a.child2;
+
+	Node &b = nodes[iB];
+	Node &c = nodes[iC];
+
+	int heightDifference = c.height - b.height;
+
+	// Rotate C up
+	if (heightDifference > 1) {
+		int iF = c.child1;
+		int iG = c.child2;
+
+		Node &f = nodes[iF];
+		Node &g = nodes[iG];
+
+		// Swap A and C
+		c.child1 = iA;
+		c.parent = a.parent;
+		a.parent = iC;
+
+		// Old parent of A should point to C
+		if (c.parent != -1) {
+			if (nodes[c.parent].child1 == iA)
+				nodes[c.parent].child1 = iC;
+			else
+				nodes[c.parent].child2 = iC;
+		}
+		else
+			root = iC;
+
+		// Keep the taller child of C under C
+		if (f.height > g.height) {
+			c.child2 = iF;
+			a.child2 = iG;
+			g.parent = iA;
+
+			a.aabb = rectCombine(b.aabb, g.aabb);
+			c.aabb = rectCombine(a.aabb, f.aabb);
+
+			a.height = 1 + std::max(b.height, g.height);
+			c.height = 1 + std::max(a.height, f.height);
+		}
+		else {
+			c.child2 = iG;
+			a.child2 = iF;
+			f.parent = iA;
+
+			a.aabb = rectCombine(b.aabb, f.aabb);
+			c.aabb = rectCombine(a.aabb, g.aabb);
+
+			a.height = 1 + std::max(b.height, f.height);
+			c.height = 1 + std::max(a.height, g.height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (heightDifference < -1) {
+		int iD = b.child1;
+		int iE = b.child2;
+
+		Node &d = nodes[iD];
+		Node &e = nodes[iE];
+
+		// Swap A and B
+		b.child1 = iA;
+		b.parent = a.parent;
+		a.parent = iB;
+
+		// Old parent of A should point to B
+		if (b.parent != -1) {
+			if (nodes[b.parent].child1 == iA)
+				nodes[b.parent].child1 = iB;
+			else
+				nodes[b.parent].child2 = iB;
+		}
+		else
+			root = iB;
+
+		// Keep the taller child of B under B
+		if (d.height > e.height) {
+			b.child2 = iD;
+			a.child1 = iE;
+			e.parent = iA;
+
+			a.aabb = rectCombine(c.aabb, e.aabb);
+			b.aabb = rectCombine(a.aabb, d.aabb);
+
+			a.height = 1 + std::max(c.height, e.height);
+			b.height = 1 + std::max(a.height, d.height);
+		}
+		else {
+			b.child2 = iE;
+			a.child1 = iD;
+			d.parent = iA;
+
+			a.aabb = rectCombine(c.aabb, d.aabb);
+			b.aabb = rectCombine(a.aabb, e.aabb);
+
+			a.height = 1 + std::max(c.height, d.height);
+			b.height = 1 + std::max(a.height, e.height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+void DynamicAABBTree::add(QuadtreeOccupant* oc) {
+	assert(oc->aabbTreeLeaf == -1);
+
+	setSpatialIndex(oc);
+
+	oc->updateAABB();
+
+	int leaf = allocateNode();
+
+	nodes[leaf].aabb = getFatAABB(oc->aabb);
+	nodes[leaf].pOccupant = oc;
+
+	oc->aabbTreeLeaf = leaf;
+
+	insertLeaf(leaf);
+}
+
+void DynamicAABBTree::update(QuadtreeOccupant* oc) {
+	assert(oc->aabbTreeLeaf != -1);
+
+	oc->updateAABB();
+
+	int leaf = oc->aabbTreeLeaf;
+
+	// Still inside the extended AABB, nothing to do
+	if (rectContains(nodes[leaf].aabb, oc->aabb))
+		return;
+
+	removeLeaf(leaf);
+
+	nodes[leaf].aabb = getFatAABB(oc->aabb);
+
+	insertLeaf(leaf);
+}
+
+void DynamicAABBTree::remove(QuadtreeOccupant* oc) {
+	assert(oc->aabbTreeLeaf != -1);
+
+	removeLeaf(oc->aabbTreeLeaf);
+	freeNode(oc->aabbTreeLeaf);
+
+	oc->aabbTreeLeaf = -1;
+}
+
+void DynamicAABBTree::clear() {
+	for (unsigned i = 0; i < nodes.size(); i++)
+	if (nodes[i].pOccupant != nullptr) {
+		nodes[i].pOccupant->aabbTreeLeaf = -1;
+		nodes[i].pOccupant->pSpatialIndex = nullptr;
+	}
+
+	nodes.clear();
+
+	root = -1;
+	freeList = -1;
+}
+
+void DynamicAABBTree::queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) {
+	queryRegion(region, [&result](QuadtreeOccupant* oc) { result.push_back(oc); });
+}
+
+void DynamicAABBTree::queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p) {
+	if (root == -1)
+		return;
+
+	queryStack.clear();
+
+	queryStack.push_back(root);
+
+	while (!queryStack.empty()) {
+		// Depth-first (results in less memory usage), remove nodes from open list
+		const Node &current = nodes[queryStack.back()];
+		queryStack.pop_back();
+
+		if (!current.aabb.contains(p))
+			continue;
+
+		if (current.isLeaf()) {
+			if (current.pOccupant->aabb.contains(p))
+				result.push_back(current.pOccupant);
+		}
+		else {
+			queryStack.push_back(current.child1);
+			queryStack.push_back(current.child2);
+		}
+	}
+}
+
+void DynamicAABBTree::queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape) {
+	if (root == -1)
+		return;
+
+	queryStack.clear();
+
+	queryStack.push_back(root);
+
+	while (!queryStack.empty()) {
+		// Depth-first (results in less memory usage), remove nodes from open list
+		const Node &current = nodes[queryStack.back()];
+		queryStack.pop_back();
+
+		if (!shapeIntersection(shapeFromRect(current.aabb), shape))
+			continue;
+
+		if (current.isLeaf()) {
+			if (shapeIntersection(shapeFromRect(current.pOccupant->aabb), shape))
+				result.push_back(current.pOccupant);
+		}
+		else {
+			queryStack.push_back(current.child1);
+			queryStack.push_back(current.child2);
+		}
+	}
+}
+
+void DynamicAABBTree::queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits) {
+	if (root == -1 || k == 0)
+		return;
+
+	size_t first = hits.size();
+
+	// Greater, so the heap is a min heap
+	auto nodeGreater = [](const std::pair<float, int> &left, const std::pair<float, int> &right) {
+		return left.first > right.first;
+	};
+
+	nearestQueue.clear();
+
+	nearestQueue.push_back(std::make_pair(rectDistance(nodes[root].aabb, p), root));
+
+	while (!nearestQueue.empty()) {
+		std::pop_heap(nearestQueue.begin(), nearestQueue.end(), nodeGreater);
+
+		float distance = nearestQueue.back().first;
+		const Node &current = nodes[nearestQueue.back().second];
+
+		nearestQueue.pop_back();
+
+		// Node AABBs contain their occupants, so all remaining ones are farther than the k closest
+		if (distance > getNearestBound(hits, first, k))
+			break;
+
+		if (current.isLeaf())
+			addNearest(hits, first, k, current.pOccupant, vectorMagnitude(rectCenter(current.pOccupant->aabb) - p));
+		else {
+			nearestQueue.push_back(std::make_pair(rectDistance(nodes[current.child1].aabb, p), current.child1));
+
+			std::push_heap(nearestQueue.begin(), nearestQueue.end(), nodeGreater);
+
+			nearestQueue.push_back(std::make_pair(rectDistance(nodes[current.child2].aabb, p), current.child2));
+
+			std::push_heap(nearestQueue.begin(), nearestQueue.end(), nodeGreater);
+		}
+	}
+
+	sortNearest(hits, first);
+}
+
+bool DynamicAABBTree::rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit) {
+	rayCastHits.clear();
+
+	rayCastNodes(start, vectorNormalize(direction), maxDistance, true, rayCastHits);
+
+	if (rayCastHits.empty())
+		return false;
+
+	hit = rayCastHits.front();
+
+	return true;
+}
+
+void DynamicAABBTree::rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits) {
+	size_t first = hits.size();
+
+	rayCastNodes(start, vectorNormalize(direction), maxDistance, false, hits);
+
+	std::sort(hits.begin() + first, hits.end(), [](const RayCastHit &left, const RayCastHit &right) {
+		return left.distance < right.distance;
+	});
+}
+
+void DynamicAABBTree::rayCastNodes(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, bool closestOnly, std::vector<RayCastHit> &hits) {
+	if (root == -1)
+		return;
+
+	size_t first = hits.size();
+
+	sf::Vector2f directionInv(1.0f / direction.x, 1.0f / direction.y);
+
+	float distance;
+
+	if (!rayRectIntersection(nodes[root].aabb, start, directionInv, maxDistance, distance))
+		return;
+
+	rayCastStack.clear();
+
+	rayCastStack.push_back(std::make_pair(root, distance));
+
+	while (!rayCastStack.empty()) {
+		const Node &current = nodes[rayCastStack.back().first];
+		float entryDistance = rayCastStack.back().second;
+		rayCastStack.pop_back();
+
+		// Behind the closest hit so far
+		if (entryDistance > maxDistance)
+			continue;
+
+		if (current.isLeaf()) {
+			QuadtreeOccupant* oc = current.pOccupant;
+
+			RayCastHit hit;
+
+			if (!rayRectIntersection(oc->aabb, start, directionInv, maxDistance, hit.distance) || !oc->rayCast(start, direction, maxDistance, hit.distance))
+				continue;
+
+			hit.pOccupant = oc;
+
+			if (closestOnly) {
+				if (hits.size() == first)
+					hits.push_back(hit);
+				else
+					hits[first] = hit;
+
+				maxDistance = hit.distance;
+			}
+			else
+				hits.push_back(hit);
+
+			continue;
+		}
+
+		// Push the crossed children farthest first, so the closest is visited next
+		float distance1, distance2;
+
+		bool crosses1 = rayRectIntersection(nodes[current.child1].aabb, start, directionInv, maxDistance, distance1);
+		bool crosses2 = rayRectIntersection(nodes[current.child2].aabb, start, directionInv, maxDistance, distance2);
+
+		int child1 = current.child1;
+		int child2 = current.child2;
+
+		if (crosses1 && crosses2) {
+			if (distance1 < distance2) {
+				rayCastStack.push_back(std::make_pair(child2, distance2));
+				rayCastStack.push_back(std::make_pair(child1, distance1));
+			}
+			else {
+				rayCastStack.push_back(std::make_pair(child1, distance1));
+				rayCastStack.push_back(std::make_pair(child2, distance2));
+			}
+		}
+		else if (crosses1)
+			rayCastStack.push_back(std::make_pair(child1, distance1));
+		else if (crosses2)
+			rayCastStack.push_back(std::make_pair(child2, distance2));
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "SpatialIndex.h"
+
+#include <vector>
+#include <utility>
+
+namespace ltbl {
+	// Dynamic AABB tree (bounding volume hierarchy), an alternative to DynamicQuadtree for very uneven worlds.
+	// Leaves store the AABB of their occupant extended by a margin, so small moves do not require reinsertion.
+	// Insertion picks the sibling that least increases the perimeter of the tree, and rotations after every
+	// insertion and removal keep it balanced. There is no root region, so nothing needs trimming
+	class DynamicAABBTree : public SpatialIndex {
+	private:
+		struct Node {
+			// Extended by margin for leaves
+			sf::FloatRect aabb;
+
+			// Only set for leaves
+			QuadtreeOccupant* pOccupant;
+
+			// Next free node when on the free list
+			int parent;
+
+			int child1;
+			int child2;
+
+			// 0 for leaves, -1 for free nodes
+			int height;
+
+			bool isLeaf() const {
+				return child1 == -1;
+			}
+		};
+
+		std::vector<Node> nodes;
+
+		int root;
+		int freeList;
+
+		// Scratch open list reused by the visitor queries that do not take one
+		std::vector<int> queryStack;
+
+		// Open list of k-nearest queries, a min heap of nodes on their distance to the query point
+		std::vector<std::pair<float, int>> nearestQueue;
+
+		// Open list of ray casts, nodes with the distance at which the ray enters them
+		std::vector<std::pair<int, float>> rayCastStack;
+
+		// Hit list of rayCast(), reused so it does not allocate
+		std::vector<RayCastHit> rayCastHits;
+
+		// Visits the nodes the ray crosses front to back. If closestOnly, keeps only the closest hit and skips
+		// everything behind it
+		void rayCastNodes(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, bool closestOnly, std::vector<RayCastHit> &hits);
+
+		int allocateNode();
+		void freeNode(int index);
+
+		void insertLeaf(int leaf);
+		void removeLeaf(int leaf);
+
+		// Rotates the subtree at index if it is imbalanced, returns the index of the new subtree root
+		int balance(int index);
+
+		sf::FloatRect getFatAABB(const sf::FloatRect &aabb) const;
+
+	protected:
+		// Inherited from SpatialIndex
+		void update(QuadtreeOccupant* oc);
+		void remove(QuadtreeOccupant* oc);
+
+	public:
+		// Amount leaf AABBs are extended by on every side
+		float margin;
+
+		DynamicAABBTree()
+			: root(-1), freeList(-1), margin(8.0f)
+		{}
+
+		// Inherited from SpatialIndex
+		void add(QuadtreeOccupant* oc);
+
+		void clear();
+
+		void queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region);
+		void queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p);
+		void queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape);
+
+		// Best first, visits nodes in order of distance until they are farther than the k-th closest occupant
+		void queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits);
+
+		bool rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit);
+		void rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits);
+
+		// Visitor queries, same as the ones of Quadtree
+		template<class Visitor>
+		void queryRegion(const sf::FloatRect &region, Visitor &&visitor) {
+			queryRegion(queryStack, region, std::forward<Visitor>(visitor));
+		}
+
+		template<class Visitor>
+		void queryRegion(std::vector<int> &open, const sf::FloatRect &region, Visitor &&visitor);
+
+		// Height of the root, 0 when empty or only a single leaf
+		int getHeight() const {
+			return root == -1 ? 0 : nodes[root].height;
+		}
+	};
+
+	template<class Visitor>
+	void DynamicAABBTree::queryRegion(std::vector<int> &open, const sf::FloatRect &region, Visitor &&visitor) {
+		if (root == -1)
+			return;
+
+		open.clear();
+
+		open.push_back(root);
+
+		while (!open.empty()) {
+			// Depth-first (results in less memory usage), remove nodes from open list
+			const Node &current = nodes[open.back()];
+			open.pop_back();
+
+			if (!region.intersects(current.aabb))
+				continue;
+
+			if (current.isLeaf()) {
+				// Test the actual AABB, the node one is extended
+				if (region.intersects(current.pOccupant->aabb))
+					visitor(current.pOccupant);
+			}
+			else {
+				open.push_back(current.child1);
+				open.push_back(current.child2);
+			}
+		}
+	}
+}
@@ -9,30 +9,28 @@ void DynamicQuadtree::operator=(const DynamicQuadtree &other) {
 
 	minOutsideRoot = other.minOutsideRoot;
 	maxOutsideRoot = other.maxOutsideRoot;
+	expandToFitOutsideRoot = other.expandToFitOutsideRoot;
+	trimTimeBudget = other.trimTimeBudget;
 }
 
 void DynamicQuadtree::add(QuadtreeOccupant* oc) {
 	assert(created());
 
+	oc->updateAABB();
+
 	// If the occupant fits in the root node
-	if (rectContains(pRootNode->getRegion(), oc->getAABB()))
+	if (rectContains(pRootNode->getRegion(), oc->aabb))
 		pRootNode->add(oc);
 	else
 		outsideRoot.insert(oc);
 
-	setQuadtree(oc);
+	setSpatialIndex(oc);
 }
 
-void DynamicQuadtree::expand() {
-	// Find direction with most occupants
-	sf::Vector2f averageDir(0.0f, 0.0f);
-
-	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
-		averageDir += vectorNormalize(rectCenter((*it)->getAABB()) - rectCenter(pRootNode->getRegion()));
-
+void DynamicQuadtree::expandTowards(const sf::Vector2f &direction) {
 	sf::Vector2f centerOffsetDist(rectHalfDims(pRootNode->getRegion()) / oversizeMultiplier);
 
-	sf::Vector2f centerOffset((averageDir.x > 0.0f ? 1.0f : -1.0f) * centerOffsetDist.x, (averageDir.y > 0.0f ? 1.0f : -1.0f) * centerOffsetDist.y);
+	sf::Vector2f centerOffset((direction.x > 0.0f ? 1.0f : -1.0f) * centerOffsetDist.x, (direction.y > 0.0f ? 1.0f : -1.0f) * centerOffsetDist.y);
 
 	// Child node position of current root node
 	int rX = centerOffset.x > 0.0f ? 0 : 1;
@@ -42,51 +40,112 @@ void DynamicQuadtree::expand() {
 
 	newRootAABB = rectRecenter(newRootAABB, centerOffset + rectCenter(pRootNode->getRegion()));
 
-        std::unique_ptr<QuadtreeNode> pNewRoot = std::make_unique<QuadtreeNode>(newRootAABB,  pRootNode->level + 1, nullptr, this);
+	int childLevel = pRootNode->level;
+
+	std::unique_ptr<QuadtreeNode> pNewRoot = std::make_unique<QuadtreeNode>(getLooseRegion(newRootAABB), childLevel + 1, nullptr, this);
 
 	// ----------------------- Manual Children Creation for New Root -------------------------
 
-	sf::Vector2f halfRegionDims = rectHalfDims(pNewRoot->region);
-	sf::Vector2f regionLowerBound = rectLowerBound(pNewRoot->region);
-	sf::Vector2f regionCenter = rectCenter(pNewRoot->region);
+	sf::Vector2f halfRegionDims = rectHalfDims(newRootAABB);
+	sf::Vector2f regionLowerBound = rectLowerBound(newRootAABB);
+	sf::Vector2f regionCenter = rectCenter(newRootAABB);
+
+	pNewRoot->children = allocateNodeBlock();
 
 	// Create the children nodes
 	for(int x = 0; x < 2; x++)
 		for(int y = 0; y < 2; y++) {
 			if(x == rX && y == rY)
-				pNewRoot->children[x + y * 2].reset(pRootNode.release());
+				// Old root becomes this child
+				pNewRoot->children[x + y * 2].moveFrom(*pRootNode, pNewRoot.get());
 			else {
 				sf::Vector2f offset(x * halfRegionDims.x, y * halfRegionDims.y);
 
 				sf::FloatRect childAABB = rectFromBounds(regionLowerBound + offset, regionCenter + offset);
 
 				// Scale up AABB by the oversize multiplier
-				sf::Vector2f center = rectCenter(childAABB);
-					
-				childAABB.width *= oversizeMultiplier;
-				childAABB.height *= oversizeMultiplier;
-
-				childAABB = rectRecenter(childAABB, center);
+				childAABB = getLooseRegion(childAABB);
 	
-				pNewRoot->children[x + y * 2] = std::make_unique<QuadtreeNode>(childAABB, pRootNode->level, pNewRoot.get(), this);
+				pNewRoot->children[x + y * 2].create(childAABB, childLevel, pNewRoot.get(), this);
 			}
 		}
 
 	pNewRoot->hasChildren = true;
-	pNewRoot->numOccupantsBelow = pRootNode->numOccupantsBelow;
-	pRootNode->pParent = pNewRoot.get();
+	pNewRoot->numOccupantsBelow = pNewRoot->children[rX + rY * 2].numOccupantsBelow;
 
 	// Transfer ownership
 	pRootNode = std::move(pNewRoot);
+}
+
+void DynamicQuadtree::expand() {
+	// Find direction with most occupants
+	sf::Vector2f averageDir(0.0f, 0.0f);
+
+	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
+		averageDir += vectorNormalize(rectCenter((*it)->aabb) - rectCenter(pRootNode->getRegion()));
+
+	expandTowards(averageDir);
 
 	// ----------------------- Try to Add Previously Outside Root -------------------------
 
-	// Make copy so don't try to re-add ones just added
-	std::unordered_set<QuadtreeOccupant*> outsideRootCopy(outsideRoot);
-	outsideRoot.clear();
+	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end();) {
+		QuadtreeOccupant* oc = *it;
+
+		if (rectContains(pRootNode->getRegion(), oc->aabb)) {
+			it = outsideRoot.erase(it);
+
+			pRootNode->add(oc);
+		}
+		else
+			it++;
+	}
+}
+
+void DynamicQuadtree::expandToFit() {
+	if (outsideRoot.empty())
+		return;
+
+	// Bounds of everything outside the root
+	std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin();
+
+	sf::FloatRect bounds = (*it)->aabb;
+
+	for (it++; it != outsideRoot.end(); it++)
+		bounds = rectCombine(bounds, (*it)->aabb);
+
+	// Each step only creates the new root and its children, so this is cheap. Limited, in case the bounds are not finite
+	const int maxSteps = 64;
 
-	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRootCopy.begin(); it != outsideRootCopy.end(); it++)
-		add(*it);
+	for (int step = 0; step < maxSteps && !rectContains(pRootNode->getRegion(), bounds); step++)
+		expandTowards(rectCenter(bounds) - rectCenter(pRootNode->getRegion()));
+}
+
+void DynamicQuadtree::addPendingToRoot(const sf::Clock &clock) {
+	// Only checking the time every so often, adding is fast
+	const int occupantsPerTimeCheck = 32;
+
+	int numAdded = 0;
+
+	while (!pendingAdd.empty()) {
+		QuadtreeOccupant* oc = pendingAdd.back();
+
+		pendingAdd.pop_back();
+
+		// May have been removed or moved since
+		std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.find(oc);
+
+		if (it == outsideRoot.end() || !rectContains(pRootNode->getRegion(), oc->aabb))
+			continue;
+
+		outsideRoot.erase(it);
+
+		pRootNode->add(oc);
+
+		numAdded++;
+
+		if (trimTimeBudget != sf::Time::Zero && numAdded % occupantsPerTimeCheck == 0 && clock.getElapsedTime() >= trimTimeBudget)
+			break;
+	}
 }
 
 void DynamicQuadtree::contract() {
@@ -96,33 +155,44 @@ void DynamicQuadtree::contract() {
 	int maxIndex = 0;
 
 	for (int i = 1; i < 4; i++)
-	if (pRootNode->children[i]->getNumOccupantsBelow() >
-		pRootNode->children[maxIndex]->getNumOccupantsBelow())
+	if (pRootNode->children[i].getNumOccupantsBelow() >
+		pRootNode->children[maxIndex].getNumOccupantsBelow())
 		maxIndex = i;
 
-	// Reorganize
-	for (int i = 0; i < 4; i++) {
-		if (i == maxIndex)
-			continue;
+	// Take over the child, everything else is moved outside the root
+	std::unique_ptr<QuadtreeNode> pNewRoot = std::make_unique<QuadtreeNode>();
 
-		pRootNode->children[i]->removeForDeletion(outsideRoot);
-	}
-
-	QuadtreeNode* pNewRoot = pRootNode->children[maxIndex].release();
-
-	pRootNode->destroyChildren();
+	pNewRoot->moveFrom(pRootNode->children[maxIndex], nullptr);
 
 	pRootNode->removeForDeletion(outsideRoot);
 
-	pRootNode.reset(pNewRoot);
+	// Keep the other children for reuse
+	pRootNode->destroyChildren();
 
-	pRootNode->pParent = nullptr;
+	pRootNode = std::move(pNewRoot);
 }
 
 void DynamicQuadtree::trim() {
 	if(pRootNode.get() == nullptr)
 		return;
 
+	if (expandToFitOutsideRoot) {
+		sf::Clock clock;
+
+		if (pendingAdd.empty() && outsideRoot.size() > maxOutsideRoot) {
+			expandToFit();
+
+			pendingAdd.assign(outsideRoot.begin(), outsideRoot.end());
+		}
+		else if (pendingAdd.empty() && outsideRoot.size() < minOutsideRoot && pRootNode->hasChildren)
+			contract();
+
+		// Continues where previous calls ran out of time
+		addPendingToRoot(clock);
+
+		return;
+	}
+
 	// Check if should grow
 	if(outsideRoot.size() > maxOutsideRoot)
 		expand();
@@ -5,21 +5,42 @@
 namespace ltbl {
 	class DynamicQuadtree : public Quadtree {
 	private:
+		// Doubles the root towards direction, the old root becomes one of the children of the new one
+		void expandTowards(const sf::Vector2f &direction);
+
 		void expand();
 		void contract();
 
+		// Grows the root in as many steps as needed to contain everything outside of it
+		void expandToFit();
+
+		// Occupants outside the root that fit in it after expandToFit(), still to be added to it
+		std::vector<QuadtreeOccupant*> pendingAdd;
+
+		// Adds pendingAdd to the root until clock passes trimTimeBudget
+		void addPendingToRoot(const sf::Clock &clock);
+
 	public:
 		size_t minOutsideRoot;
 		size_t maxOutsideRoot;
 
+		// If set, trim() grows the root to the bounds of everything outside of it at once,
+		// instead of doubling it once per call
+		bool expandToFitOutsideRoot;
+
+		// Time trim() may spend re-adding occupants to the root when expandToFitOutsideRoot is set.
+		// Whatever is left stays outside the root (still found by queries) for the next trim() calls.
+		// Zero means no limit
+		sf::Time trimTimeBudget;
+
 		DynamicQuadtree()
-			: minOutsideRoot(1), maxOutsideRoot(8)
+			: minOutsideRoot(1), maxOutsideRoot(8), expandToFitOutsideRoot(false), trimTimeBudget(sf::Time::Zero)
 		{}
 
 		DynamicQuadtree(const sf::FloatRect &rootRegion)
-			: minOutsideRoot(1), maxOutsideRoot(8)
+			: minOutsideRoot(1), maxOutsideRoot(8), expandToFitOutsideRoot(false), trimTimeBudget(sf::Time::Zero)
 		{
-			pRootNode = std::make_unique<QuadtreeNode>(rootRegion, 0, nullptr, this);
+			pRootNode = std::make_unique<QuadtreeNode>(getLooseRegion(rootRegion), 0, nullptr, this);
 		}
 
 		DynamicQuadtree(const DynamicQuadtree &other) : Quadtree(other) {
@@ -29,7 +50,7 @@ namespace ltbl {
 		void operator=(const DynamicQuadtree &other);
 
 		void create(const sf::FloatRect &rootRegion) {
-			pRootNode = std::make_unique<QuadtreeNode>(rootRegion, 0, nullptr, this);
+			pRootNode = std::make_unique<QuadtreeNode>(getLooseRegion(rootRegion), 0, nullptr, this);
 		}
 
 		// Inherited from Quadtree
@@ -37,6 +58,7 @@ namespace ltbl {
 
 		void clear() {
 			pRootNode.reset();
+			pendingAdd.clear();
 		}
 
 		// Resizes Quadtree
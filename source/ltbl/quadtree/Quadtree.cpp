@@ -1,23 +1,36 @@
 #include "Quadtree.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include <assert.h>
 
 using namespace ltbl;
 
 Quadtree::Quadtree()
-: minNumNodeOccupants(3),
+: batching(false),
+minNumNodeOccupants(3),
 maxNumNodeOccupants(6),
 maxLevels(40),
-oversizeMultiplier(1.0f)
+maxFreeNodeBlocks(256),
+oversizeMultiplier(1.0f),
+countQueries(false)
 {}
 
 void Quadtree::operator=(const Quadtree &other) {
 	minNumNodeOccupants = other.minNumNodeOccupants;
 	maxNumNodeOccupants = other.maxNumNodeOccupants;
 	maxLevels = other.maxLevels;
+	maxFreeNodeBlocks = other.maxFreeNodeBlocks;
 	oversizeMultiplier = other.oversizeMultiplier;
+	countQueries = other.countQueries;
+
+	// A batch is not copied, the copy has none open
+	for (size_t i = 0; i < batchOccupants.size(); i++)
+		batchOccupants[i]->batchIndex = -1;
+
+	batching = false;
+	batchOccupants.clear();
 
 	outsideRoot = other.outsideRoot;
 
@@ -28,8 +41,187 @@ void Quadtree::operator=(const Quadtree &other) {
 	}
 }
 
-void Quadtree::setQuadtree(QuadtreeOccupant* oc) {
-	oc->pQuadtree = this;
+void Quadtree::update(QuadtreeOccupant* oc) {
+	// Defer to the commit of the batch
+	if (batching) {
+		if (oc->batchIndex == -1) {
+			oc->batchIndex = batchOccupants.size();
+
+			batchOccupants.push_back(oc);
+		}
+
+		return;
+	}
+
+	if (oc->pQuadtreeNode != nullptr) {
+		oc->updateAABB();
+
+		oc->pQuadtreeNode->update(oc);
+	}
+	else {
+		outsideRoot.erase(oc);
+
+		add(oc);
+	}
+}
+
+void Quadtree::remove(QuadtreeOccupant* oc) {
+	if (oc->batchIndex != -1)
+		removeFromBatch(oc);
+
+	if (oc->pQuadtreeNode != nullptr)
+		oc->pQuadtreeNode->remove(oc);
+	else
+		outsideRoot.erase(oc);
+}
+
+namespace {
+	// Spreads the lower 16 bits of x to the even bits
+	unsigned spreadBits(unsigned x) {
+		x &= 0x0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+
+		return x;
+	}
+
+	// Cell of a normalized coordinate at the given resolution. Like QuadtreeNode::getPossibleOccupantPosition,
+	// a center exactly on a split goes to the lower child
+	unsigned quantize(float t, unsigned resolution) {
+		float cell = std::ceil(t * resolution) - 1.0f;
+
+		return static_cast<unsigned>(std::min(std::max(cell, 0.0f), static_cast<float>(resolution - 1)));
+	}
+
+	// Least significant digit radix sort on the codes, 8 bits per pass
+	void sortByCode(std::vector<std::pair<unsigned, QuadtreeOccupant*>> &entries) {
+		std::vector<std::pair<unsigned, QuadtreeOccupant*>> sorted(entries.size());
+
+		for (unsigned shift = 0; shift < 32; shift += 8) {
+			size_t offsets[256] = { 0 };
+
+			for (size_t i = 0; i < entries.size(); i++)
+				offsets[(entries[i].first >> shift) & 0xff]++;
+
+			size_t total = 0;
+
+			for (int d = 0; d < 256; d++) {
+				size_t count = offsets[d];
+
+				offsets[d] = total;
+
+				total += count;
+			}
+
+			for (size_t i = 0; i < entries.size(); i++)
+				sorted[offsets[(entries[i].first >> shift) & 0xff]++] = entries[i];
+
+			entries.swap(sorted);
+		}
+	}
+}
+
+void Quadtree::bulkAdd(const std::vector<QuadtreeOccupant*> &occupants) {
+	assert(pRootNode != nullptr);
+
+	if (pRootNode->numOccupantsBelow != 0 || pRootNode->hasChildren) {
+		SpatialIndex::bulkAdd(occupants);
+
+		return;
+	}
+
+	sf::FloatRect tightRootRegion = getTightRegion(pRootNode->region);
+
+	sf::Vector2f rootLowerBound = rectLowerBound(tightRootRegion);
+	sf::Vector2f rootDimsInv(1.0f / tightRootRegion.width, 1.0f / tightRootRegion.height);
+
+	const unsigned resolution = 1u << mortonLevels;
+
+	std::vector<BuildEntry> entries;
+
+	entries.reserve(occupants.size());
+
+	for (std::vector<QuadtreeOccupant*>::const_iterator it = occupants.begin(); it != occupants.end(); it++) {
+		QuadtreeOccupant* oc = *it;
+
+		setSpatialIndex(oc);
+
+		oc->updateAABB();
+
+		if (!rectContains(pRootNode->region, oc->aabb)) {
+			outsideRoot.insert(oc);
+
+			continue;
+		}
+
+		sf::Vector2f center = rectCenter(oc->aabb);
+
+		unsigned x = quantize((center.x - rootLowerBound.x) * rootDimsInv.x, resolution);
+		unsigned y = quantize((center.y - rootLowerBound.y) * rootDimsInv.y, resolution);
+
+		// Child index is x + y * 2, so x takes the lower bit of every level
+		entries.push_back(BuildEntry(spreadBits(x) | (spreadBits(y) << 1), oc));
+	}
+
+	sortByCode(entries);
+
+	buildNode(pRootNode.get(), entries, 0, entries.size(), 0);
+}
+
+void Quadtree::buildNode(QuadtreeNode* pNode, std::vector<BuildEntry> &entries, size_t first, size_t last, int depth) {
+	size_t count = last - first;
+
+	// Fits without partitioning, same as QuadtreeNode::add
+	if (count <= maxNumNodeOccupants || !pNode->canPartition()) {
+		for (size_t i = first; i < last; i++)
+			pNode->insertOccupant(entries[i].second);
+
+		pNode->numOccupantsBelow = count;
+
+		return;
+	}
+
+	// Beyond the resolution of the codes, fall back to regular adds
+	if (depth >= mortonLevels) {
+		for (size_t i = first; i < last; i++)
+			pNode->add(entries[i].second);
+
+		return;
+	}
+
+	pNode->partition();
+
+	pNode->numOccupantsBelow = count;
+
+	unsigned shift = 2 * (mortonLevels - 1 - depth);
+
+	// Occupants that do not fit in the child of their quadrant stay in this node, the rest is compacted in order
+	size_t fittingLast = first;
+
+	for (size_t i = first; i < last; i++) {
+		QuadtreeNode* pChild = &pNode->children[(entries[i].first >> shift) & 3];
+
+		if (rectContains(pChild->region, entries[i].second->aabb))
+			entries[fittingLast++] = entries[i];
+		else
+			pNode->insertOccupant(entries[i].second);
+	}
+
+	// Sorted by code, so the occupants of each child are a contiguous range
+	size_t childFirst = first;
+
+	for (unsigned c = 0; c < 4; c++) {
+		size_t childLast = childFirst;
+
+		while (childLast < fittingLast && ((entries[childLast].first >> shift) & 3) == c)
+			childLast++;
+
+		buildNode(&pNode->children[c], entries, childFirst, childLast, depth + 1);
+
+		childFirst = childLast;
+	}
 }
 
 void Quadtree::recursiveCopy(QuadtreeNode* pThisNode, QuadtreeNode* pOtherNode, QuadtreeNode* pThisParent) {
@@ -43,132 +235,537 @@ void Quadtree::recursiveCopy(QuadtreeNode* pThisNode, QuadtreeNode* pOtherNode,
 
 	pThisNode->pQuadtree = this;
 
-	if (pThisNode->hasChildren)
+	if (pThisNode->hasChildren) {
+		pThisNode->children = allocateNodeBlock();
+
+		for (int i = 0; i < 4; i++)
+			recursiveCopy(&pThisNode->children[i], &pOtherNode->children[i], pThisNode);
+	}
+}
+
+std::unique_ptr<QuadtreeNode[]> Quadtree::allocateNodeBlock() {
+	if (freeNodeBlocks.empty())
+		return std::unique_ptr<QuadtreeNode[]>(new QuadtreeNode[4]);
+
+	std::unique_ptr<QuadtreeNode[]> block = std::move(freeNodeBlocks.back());
+
+	freeNodeBlocks.pop_back();
+
+	return block;
+}
+
+void Quadtree::freeNodeBlock(std::unique_ptr<QuadtreeNode[]> block) {
 	for (int i = 0; i < 4; i++) {
-		pThisNode->children[i] = std::make_unique<QuadtreeNode>();
+		QuadtreeNode &node = block[i];
+
+		if (node.hasChildren)
+			freeNodeBlock(std::move(node.children));
+
+		// Clearing keeps the capacity
+		node.occupants.clear();
 
-		recursiveCopy(pThisNode->children[i].get(), pOtherNode->children[i].get(), pThisNode);
+		node.hasChildren = false;
+		node.numOccupantsBelow = 0;
+		node.batchDirty = false;
+
+		node.pSnapshotNode.reset();
+		node.snapshotDirty = true;
 	}
+
+	// Otherwise deleted when going out of scope
+	if (freeNodeBlocks.size() < maxFreeNodeBlocks)
+		freeNodeBlocks.push_back(std::move(block));
+}
+
+std::shared_ptr<const QuadtreeSnapshotNode> Quadtree::getSnapshotNode(QuadtreeNode* pNode) {
+	// Unchanged, and so is everything below it
+	if (!pNode->snapshotDirty)
+		return pNode->pSnapshotNode;
+
+	std::shared_ptr<QuadtreeSnapshotNode> pSnapshotNode = std::make_shared<QuadtreeSnapshotNode>();
+
+	pSnapshotNode->region = pNode->region;
+
+	pSnapshotNode->occupants.resize(pNode->occupants.size());
+
+	for (unsigned i = 0; i < pNode->occupants.size(); i++) {
+		pSnapshotNode->occupants[i].pOccupant = pNode->occupants[i];
+		pSnapshotNode->occupants[i].aabb = pNode->occupants[i]->aabb;
+	}
+
+	if (pNode->hasChildren)
+	for (int i = 0; i < 4; i++)
+		pSnapshotNode->children[i] = getSnapshotNode(&pNode->children[i]);
+
+	pNode->pSnapshotNode = pSnapshotNode;
+	pNode->snapshotDirty = false;
+
+	return pNode->pSnapshotNode;
+}
+
+QuadtreeSnapshot Quadtree::getSnapshot() {
+	std::shared_ptr<std::vector<QuadtreeSnapshotEntry>> snapshotOutsideRoot = std::make_shared<std::vector<QuadtreeSnapshotEntry>>();
+
+	snapshotOutsideRoot->reserve(outsideRoot.size());
+
+	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
+	if (*it != nullptr) {
+		QuadtreeSnapshotEntry entry;
+
+		entry.pOccupant = *it;
+		entry.aabb = (*it)->aabb;
+
+		snapshotOutsideRoot->push_back(entry);
+	}
+
+	if (pRootNode == nullptr)
+		return QuadtreeSnapshot(nullptr, snapshotOutsideRoot);
+
+	return QuadtreeSnapshot(getSnapshotNode(pRootNode.get()), snapshotOutsideRoot);
 }
 
 void Quadtree::pruneDeadReferences() {
 	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end();)
 	if ((*it) == nullptr)
-		it++;
-	else
 		it = outsideRoot.erase(it);
+	else
+		it++;
 
 	if (pRootNode != nullptr)
 		pRootNode->pruneDeadReferences();
 }
 
-void Quadtree::queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) {
-	// Query outside root elements
-	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
-		QuadtreeOccupant* oc = *it;
-		if (oc != nullptr && region.intersects(oc->getAABB()))
-			// Intersects, add to list
-			result.push_back(oc);
-	}
+sf::FloatRect Quadtree::getLooseRegion(const sf::FloatRect &region) const {
+	sf::FloatRect looseRegion = region;
 
-	std::list<QuadtreeNode*> open;
+	looseRegion.width *= oversizeMultiplier;
+	looseRegion.height *= oversizeMultiplier;
 
-	open.push_back(pRootNode.get());
+	return rectRecenter(looseRegion, rectCenter(region));
+}
 
-	while (!open.empty()) {
-		// Depth-first (results in less memory usage), remove objects from open list
-		QuadtreeNode* pCurrent = open.back();
-		open.pop_back();
+sf::FloatRect Quadtree::getTightRegion(const sf::FloatRect &looseRegion) const {
+	sf::FloatRect region = looseRegion;
+
+	region.width /= oversizeMultiplier;
+	region.height /= oversizeMultiplier;
+
+	return rectRecenter(region, rectCenter(looseRegion));
+}
+
+void Quadtree::beginBatch() {
+	batching = true;
+}
+
+void Quadtree::removeFromBatch(QuadtreeOccupant* oc) {
+	assert(batchOccupants[oc->batchIndex] == oc);
+
+	// Swap with last, then shrink
+	QuadtreeOccupant* pLast = batchOccupants.back();
+
+	batchOccupants[oc->batchIndex] = pLast;
+	pLast->batchIndex = oc->batchIndex;
+
+	batchOccupants.pop_back();
+
+	oc->batchIndex = -1;
+}
+
+void Quadtree::commitBatch() {
+	batching = false;
 
-		if (region.intersects(pCurrent->region)) {
-			for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++) {
-				QuadtreeOccupant* oc = *it;
+	// Pull out the occupants that no longer belong in their node, keeping the node they start searching from
+	std::vector<std::pair<QuadtreeOccupant*, QuadtreeNode*>> moved;
 
-				if (oc != nullptr && region.intersects(oc->getAABB()))
-					// Visible, add to list
-					result.push_back(oc);
+	for (unsigned i = 0; i < batchOccupants.size(); i++) {
+		QuadtreeOccupant* oc = batchOccupants[i];
+
+		oc->batchIndex = -1;
+
+		oc->updateAABB();
+
+		QuadtreeNode* pNode = oc->pQuadtreeNode;
+
+		if (pNode != nullptr) {
+			// Still the deepest node it fits in, only the snapshot needs the new AABB
+			if (rectContains(pNode->region, oc->aabb) && (!pNode->hasChildren || pNode->getFittingChild(oc) == nullptr)) {
+				pNode->markSnapshotDirty();
+
+				continue;
 			}
 
-			// Add children to open list if they intersect the region
-			if (pCurrent->hasChildren)
-			for (int i = 0; i < 4; i++)
-			if (pCurrent->children[i]->getNumOccupantsBelow() != 0)
-				open.push_back(pCurrent->children[i].get());
+			pNode->eraseOccupant(oc);
+			pNode->markBatchDirty();
+		}
+		else {
+			outsideRoot.erase(oc);
+
+			pNode = pRootNode.get();
+		}
+
+		moved.push_back(std::make_pair(oc, pNode));
+	}
+
+	batchOccupants.clear();
+
+	// Reinsert without partitioning, that is settled once afterwards
+	for (unsigned i = 0; i < moved.size(); i++) {
+		QuadtreeOccupant* oc = moved[i].first;
+		QuadtreeNode* pNode = moved[i].second;
+
+		// Go up until it fits, then down as far as it fits
+		while (pNode != nullptr && !rectContains(pNode->region, oc->aabb))
+			pNode = pNode->pParent;
+
+		if (pNode == nullptr) {
+			outsideRoot.insert(oc);
+
+			continue;
 		}
+
+		while (pNode->hasChildren) {
+			QuadtreeNode* pChild = pNode->getFittingChild(oc);
+
+			if (pChild == nullptr)
+				break;
+
+			pNode = pChild;
+		}
+
+		pNode->insertOccupant(oc);
+		pNode->markBatchDirty();
 	}
+
+	if (pRootNode != nullptr && pRootNode->batchDirty)
+		pRootNode->settleBatch();
+}
+
+void Quadtree::queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) {
+	queryRegion(region, [&result](QuadtreeOccupant* oc) { result.push_back(oc); });
 }
 
 void Quadtree::queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p) {
+	queryPoint(p, [&result](QuadtreeOccupant* oc) { result.push_back(oc); });
+}
+
+void Quadtree::queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape) {
+	queryShape(shape, [&result](QuadtreeOccupant* oc) { result.push_back(oc); });
+}
+
+void Quadtree::queryOrientedRect(std::vector<QuadtreeOccupant*> &result, const OrientedRect &orientedRect) {
+	queryOrientedRect(orientedRect, [&result](QuadtreeOccupant* oc) { result.push_back(oc); });
+}
+
+void Quadtree::queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits) {
+	size_t first = hits.size();
+
 	// Query outside root elements
-	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
-		QuadtreeOccupant* oc = *it;
+	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
+	if (*it != nullptr)
+		addNearest(hits, first, k, *it, vectorMagnitude(rectCenter((*it)->aabb) - p));
 
-		if (oc != nullptr && oc->getAABB().contains(p))
-			// Intersects, add to list
-			result.push_back(oc);
-	}
+	if (pRootNode != nullptr && k != 0) {
+		// Greater, so the heap is a min heap
+		auto nodeGreater = [](const std::pair<float, QuadtreeNode*> &left, const std::pair<float, QuadtreeNode*> &right) {
+			return left.first > right.first;
+		};
 
-	std::list<QuadtreeNode*> open;
+		nearestQueue.clear();
 
-	open.push_back(pRootNode.get());
+		nearestQueue.push_back(std::make_pair(rectDistance(pRootNode->region, p), pRootNode.get()));
 
-	while (!open.empty()) {
-		// Depth-first (results in less memory usage), remove objects from open list
-		QuadtreeNode* pCurrent = open.back();
-		open.pop_back();
+		while (!nearestQueue.empty()) {
+			std::pop_heap(nearestQueue.begin(), nearestQueue.end(), nodeGreater);
 
-		if (pCurrent->region.contains(p)) {
-			for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++) {
-				QuadtreeOccupant* oc = *it;
+			float distance = nearestQueue.back().first;
+			QuadtreeNode* pCurrent = nearestQueue.back().second;
 
-				if (oc != nullptr && oc->getAABB().contains(p))
-					// Visible, add to list
-					result.push_back(oc);
-			}
+			nearestQueue.pop_back();
+
+			// Occupants are contained in their node, so all remaining ones are farther than the k closest
+			if (distance > getNearestBound(hits, first, k))
+				break;
+
+			for (unsigned i = 0; i < pCurrent->occupants.size(); i++)
+				addNearest(hits, first, k, pCurrent->occupants[i], vectorMagnitude(rectCenter(pCurrent->occupants[i]->aabb) - p));
 
-			// Add children to open list if they intersect the region
 			if (pCurrent->hasChildren)
 			for (int i = 0; i < 4; i++)
-			if (pCurrent->children[i]->getNumOccupantsBelow() != 0)
-				open.push_back(pCurrent->children[i].get());
+			if (pCurrent->children[i].getNumOccupantsBelow() != 0) {
+				nearestQueue.push_back(std::make_pair(rectDistance(pCurrent->children[i].region, p), &pCurrent->children[i]));
+
+				std::push_heap(nearestQueue.begin(), nearestQueue.end(), nodeGreater);
+			}
 		}
 	}
+
+	sortNearest(hits, first);
 }
 
-void Quadtree::queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape) {
+bool Quadtree::rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit) {
+	rayCastHits.clear();
+
+	rayCastNodes(start, vectorNormalize(direction), maxDistance, true, rayCastHits);
+
+	if (rayCastHits.empty())
+		return false;
+
+	hit = rayCastHits.front();
+
+	return true;
+}
+
+void Quadtree::rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits) {
+	size_t first = hits.size();
+
+	rayCastNodes(start, vectorNormalize(direction), maxDistance, false, hits);
+
+	std::sort(hits.begin() + first, hits.end(), [](const RayCastHit &left, const RayCastHit &right) {
+		return left.distance < right.distance;
+	});
+}
+
+void Quadtree::rayCastNodes(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, bool closestOnly, std::vector<RayCastHit> &hits) {
+	size_t first = hits.size();
+
+	sf::Vector2f directionInv(1.0f / direction.x, 1.0f / direction.y);
+
+	// Tests an occupant, shrinking maxDistance to the closest hit if closestOnly
+	auto testOccupant = [&](QuadtreeOccupant* oc) {
+		RayCastHit hit;
+
+		if (oc == nullptr || !rayRectIntersection(oc->aabb, start, directionInv, maxDistance, hit.distance) || !oc->rayCast(start, direction, maxDistance, hit.distance))
+			return;
+
+		hit.pOccupant = oc;
+
+		if (closestOnly) {
+			if (hits.size() == first)
+				hits.push_back(hit);
+			else
+				hits[first] = hit;
+
+			maxDistance = hit.distance;
+		}
+		else
+			hits.push_back(hit);
+	};
+
 	// Query outside root elements
+	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
+		testOccupant(*it);
+
+	float distance;
+
+	if (pRootNode == nullptr || !rayRectIntersection(pRootNode->region, start, directionInv, maxDistance, distance))
+		return;
+
+	rayCastStack.clear();
+
+	rayCastStack.push_back(std::make_pair(pRootNode.get(), distance));
+
+	while (!rayCastStack.empty()) {
+		QuadtreeNode* pCurrent = rayCastStack.back().first;
+		float entryDistance = rayCastStack.back().second;
+		rayCastStack.pop_back();
+
+		// Behind the closest hit so far
+		if (entryDistance > maxDistance)
+			continue;
+
+		for (unsigned i = 0; i < pCurrent->occupants.size(); i++)
+			testOccupant(pCurrent->occupants[i]);
+
+		if (!pCurrent->hasChildren)
+			continue;
+
+		// Push the crossed children farthest first, so the closest is visited next
+		size_t childrenFirst = rayCastStack.size();
+
+		for (int i = 0; i < 4; i++)
+		if (pCurrent->children[i].getNumOccupantsBelow() != 0 && rayRectIntersection(pCurrent->children[i].region, start, directionInv, maxDistance, distance))
+			rayCastStack.push_back(std::make_pair(&pCurrent->children[i], distance));
+
+		std::sort(rayCastStack.begin() + childrenFirst, rayCastStack.end(), [](const std::pair<QuadtreeNode*, float> &left, const std::pair<QuadtreeNode*, float> &right) {
+			return left.second > right.second;
+		});
+	}
+}
+
+void Quadtree::queryRegionsNode(QuadtreeNode* pNode, const std::vector<sf::FloatRect> &regions, size_t first, QueryCounter &counter) {
+	size_t last = regionQueryIndices.size();
+
+	counter.numNodesVisited++;
+
+	// Bounds of the regions, to skip the occupants that overlap none of them with a single test
+	sf::FloatRect bounds = regions[regionQueryIndices[first]];
+
+	for (size_t j = first + 1; j < last; j++)
+		bounds = rectCombine(bounds, regions[regionQueryIndices[j]]);
+
+	counter.numOccupantsTested += pNode->occupants.size();
+
+	for (unsigned i = 0; i < pNode->occupants.size(); i++) {
+		QuadtreeOccupant* oc = pNode->occupants[i];
+
+		if (!bounds.intersects(oc->aabb))
+			continue;
+
+		for (size_t j = first; j < last; j++)
+		if (regions[regionQueryIndices[j]].intersects(oc->aabb))
+			regionQueryHits.push_back(std::make_pair(regionQueryIndices[j], oc));
+	}
+
+	if (!pNode->hasChildren)
+		return;
+
+	for (int i = 0; i < 4; i++) {
+		QuadtreeNode* pChild = &pNode->children[i];
+
+		if (pChild->getNumOccupantsBelow() == 0 || !bounds.intersects(pChild->region))
+			continue;
+
+		// The regions overlapping the child go after those of this node
+		size_t childFirst = regionQueryIndices.size();
+
+		for (size_t j = first; j < last; j++)
+		if (regions[regionQueryIndices[j]].intersects(pChild->region))
+			regionQueryIndices.push_back(regionQueryIndices[j]);
+
+		if (regionQueryIndices.size() > childFirst)
+			queryRegionsNode(pChild, regions, childFirst, counter);
+
+		regionQueryIndices.resize(childFirst);
+	}
+}
+
+void Quadtree::queryRegions(const std::vector<sf::FloatRect> &regions, std::vector<QuadtreeOccupant*> &result, std::vector<size_t> &resultStarts) {
+	QueryCounter counter(this);
+
+	regionQueryHits.clear();
+
 	for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
 		QuadtreeOccupant* oc = *it;
 
-		if (oc != nullptr && shapeIntersection(shapeFromRect(oc->getAABB()), shape))
-			// Intersects, add to list
-			result.push_back(oc);
+		counter.numOccupantsTested++;
+
+		if (oc != nullptr)
+		for (unsigned j = 0; j < regions.size(); j++)
+		if (regions[j].intersects(oc->aabb))
+			regionQueryHits.push_back(std::make_pair(j, oc));
 	}
 
-	std::list<QuadtreeNode*> open;
+	if (pRootNode != nullptr) {
+		regionQueryIndices.clear();
 
-	open.push_back(pRootNode.get());
+		for (unsigned j = 0; j < regions.size(); j++)
+		if (regions[j].intersects(pRootNode->region))
+			regionQueryIndices.push_back(j);
+
+		if (!regionQueryIndices.empty())
+			queryRegionsNode(pRootNode.get(), regions, 0, counter);
+	}
+
+	counter.numHits += regionQueryHits.size();
+
+	// Group the hits by region (counting sort), keeping the order they were found in
+	size_t resultFirst = result.size();
+
+	resultStarts.assign(regions.size() + 1, 0);
+
+	for (size_t i = 0; i < regionQueryHits.size(); i++)
+		resultStarts[regionQueryHits[i].first + 1]++;
+
+	resultStarts[0] = resultFirst;
+
+	for (size_t j = 0; j < regions.size(); j++)
+		resultStarts[j + 1] += resultStarts[j];
+
+	result.resize(resultFirst + regionQueryHits.size());
+
+	// Use the starts as insertion cursors, after which each holds the start of the next region
+	for (size_t i = 0; i < regionQueryHits.size(); i++)
+		result[resultStarts[regionQueryHits[i].first]++] = regionQueryHits[i].second;
+
+	// Shift back
+	for (size_t j = regions.size(); j > 0; j--)
+		resultStarts[j] = resultStarts[j - 1];
+
+	resultStarts[0] = resultFirst;
+}
+
+Quadtree::QueryCounter::~QueryCounter() {
+	if (!pQuadtree->countQueries)
+		return;
+
+	pQuadtree->queryStats.numQueries++;
+	pQuadtree->queryStats.numNodesVisited += numNodesVisited;
+	pQuadtree->queryStats.numOccupantsTested += numOccupantsTested;
+	pQuadtree->queryStats.numHits += numHits;
+}
+
+void Quadtree::getStats(QuadtreeStats &stats) const {
+	stats.numNodes = 0;
+	stats.numLeaves = 0;
+	stats.maxDepth = 0;
+	stats.numOccupants = 0;
+	stats.numOutsideRoot = outsideRoot.size();
+	stats.averageOccupantDepth = 0.0f;
+	stats.occupantHistogram.clear();
+
+	// Buckets and entries (with a next pointer and the hash) of the unordered_set
+	stats.memoryUsage = outsideRoot.bucket_count() * sizeof(void*) + outsideRoot.size() * (sizeof(QuadtreeOccupant*) + 2 * sizeof(void*));
+
+	stats.numFreeNodeBlocks = freeNodeBlocks.size();
+
+	stats.memoryUsage += freeNodeBlocks.capacity() * sizeof(std::unique_ptr<QuadtreeNode[]>) + freeNodeBlocks.size() * 4 * sizeof(QuadtreeNode);
+
+	for (unsigned i = 0; i < freeNodeBlocks.size(); i++)
+	for (int j = 0; j < 4; j++)
+		stats.memoryUsage += freeNodeBlocks[i][j].occupants.capacity() * sizeof(QuadtreeOccupant*);
+
+	stats.memoryUsage += queryStack.capacity() * sizeof(QuadtreeNode*) + nearestQueue.capacity() * sizeof(std::pair<float, QuadtreeNode*>)
+		+ rayCastStack.capacity() * sizeof(std::pair<QuadtreeNode*, float>) + batchOccupants.capacity() * sizeof(QuadtreeOccupant*);
+
+	if (pRootNode == nullptr)
+		return;
+
+	stats.memoryUsage += sizeof(QuadtreeNode);
+
+	size_t depthSum = 0;
+
+	std::vector<std::pair<const QuadtreeNode*, int>> open;
+
+	open.push_back(std::make_pair(pRootNode.get(), 0));
 
 	while (!open.empty()) {
-		// Depth-first (results in less memory usage), remove objects from open list
-		QuadtreeNode* pCurrent = open.back();
+		const QuadtreeNode* pCurrent = open.back().first;
+		int depth = open.back().second;
 		open.pop_back();
 
-		if (shapeIntersection(shapeFromRect(pCurrent->region), shape)) {
-			for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++) {
-				QuadtreeOccupant* oc = *it;
-				sf::ConvexShape r = shapeFromRect(oc->getAABB());
+		stats.numNodes++;
+		stats.maxDepth = std::max(stats.maxDepth, depth);
+		stats.numOccupants += pCurrent->occupants.size();
 
-				if (oc != nullptr && shapeIntersection(shapeFromRect(oc->getAABB()), shape))
-					// Visible, add to list
-					result.push_back(oc);
-			}
+		depthSum += pCurrent->occupants.size() * depth;
+
+		if (stats.occupantHistogram.size() <= pCurrent->occupants.size())
+			stats.occupantHistogram.resize(pCurrent->occupants.size() + 1, 0);
+
+		stats.occupantHistogram[pCurrent->occupants.size()]++;
+
+		stats.memoryUsage += pCurrent->occupants.capacity() * sizeof(QuadtreeOccupant*);
+
+		if (pCurrent->hasChildren) {
+			stats.memoryUsage += 4 * sizeof(QuadtreeNode);
 
-			// Add children to open list if they intersect the region
-			if (pCurrent->hasChildren)
 			for (int i = 0; i < 4; i++)
-			if (pCurrent->children[i]->getNumOccupantsBelow() != 0)
-				open.push_back(pCurrent->children[i].get());
+				open.push_back(std::make_pair(&pCurrent->children[i], depth + 1));
 		}
+		else
+			stats.numLeaves++;
 	}
+
+	if (stats.numOccupants != 0)
+		stats.averageOccupantDepth = static_cast<float>(depthSum) / stats.numOccupants;
 }
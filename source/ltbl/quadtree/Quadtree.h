@@ -1,40 +1,164 @@
 #pragma once
 
+#include "SpatialIndex.h"
 #include "QuadtreeNode.h"
 
 #include <memory>
 
 #include <unordered_set>
 #include <list>
+#include <vector>
+#include <utility>
 
 #include <mutex>
 #include <thread>
 
 namespace ltbl {
+	// Shape of a Quadtree, see Quadtree::getStats
+	struct QuadtreeStats {
+		size_t numNodes;
+		size_t numLeaves;
+
+		// Depth of the deepest node, the root is at depth 0
+		int maxDepth;
+
+		size_t numOccupants;
+		size_t numOutsideRoot;
+
+		// Average depth of the nodes of the occupants (not counting outsideRoot)
+		float averageOccupantDepth;
+
+		// occupantHistogram[n] is the number of nodes with n occupants
+		std::vector<size_t> occupantHistogram;
+
+		// Child blocks kept for reuse (see Quadtree::maxFreeNodeBlocks)
+		size_t numFreeNodeBlocks;
+
+		// Estimate of the heap memory used by the tree in bytes (nodes, free nodes, occupant arrays, outsideRoot, scratch lists)
+		size_t memoryUsage;
+	};
+
+	// Work done by queries, summed over all queries since the last reset
+	struct QuadtreeQueryStats {
+		size_t numQueries;
+		size_t numNodesVisited;
+		size_t numOccupantsTested;
+		size_t numHits;
+
+		QuadtreeQueryStats()
+			: numQueries(0), numNodesVisited(0), numOccupantsTested(0), numHits(0)
+		{}
+	};
+
 	// Base class for dynamic and static Quadtree types
-	class Quadtree {
+	class Quadtree : public SpatialIndex {
 	protected:
 		std::unordered_set<QuadtreeOccupant*> outsideRoot;
 
 		std::unique_ptr<QuadtreeNode> pRootNode;
 
+		// Scratch open list reused by the visitor queries that do not take one
+		std::vector<QuadtreeNode*> queryStack;
+
+		// Open list of k-nearest queries, a min heap of nodes on their distance to the query point
+		std::vector<std::pair<float, QuadtreeNode*>> nearestQueue;
+
+		// Open list of ray casts, nodes with the distance at which the ray enters them
+		std::vector<std::pair<QuadtreeNode*, float>> rayCastStack;
+
+		// Hit list of rayCast(), reused so it does not allocate
+		std::vector<RayCastHit> rayCastHits;
+
+		// Visits the nodes the ray crosses front to back. If closestOnly, keeps only the closest hit and skips
+		// everything behind it
+		void rayCastNodes(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, bool closestOnly, std::vector<RayCastHit> &hits);
+
+		// Counts the work of one query, added to queryStats on destruction if countQueries is set
+		struct QueryCounter {
+			class Quadtree* pQuadtree;
+
+			size_t numNodesVisited;
+			size_t numOccupantsTested;
+			size_t numHits;
+
+			QueryCounter(class Quadtree* pQuadtree)
+				: pQuadtree(pQuadtree), numNodesVisited(0), numOccupantsTested(0), numHits(0)
+			{}
+
+			~QueryCounter();
+		};
+
+		// Scratch of queryRegions. Indices of the regions overlapping the nodes on the current path (a range per
+		// node), and the hits as region index and occupant
+		std::vector<unsigned> regionQueryIndices;
+		std::vector<std::pair<unsigned, QuadtreeOccupant*>> regionQueryHits;
+
+		// Tests the occupants of pNode, and recurses into its children, against the regions indexed by
+		// regionQueryIndices[first, end)
+		void queryRegionsNode(QuadtreeNode* pNode, const std::vector<sf::FloatRect> &regions, size_t first, QueryCounter &counter);
+
+		// Child blocks released by merges, handed out again by partitions. Their nodes keep the capacity of their
+		// occupant arrays, so a tree that partitions and merges around the same sizes stops allocating
+		std::vector<std::unique_ptr<QuadtreeNode[]>> freeNodeBlocks;
+
+		// A block of 4 nodes, from freeNodeBlocks if there are any. The nodes still need to be created
+		std::unique_ptr<QuadtreeNode[]> allocateNodeBlock();
+
+		// Releases a block and, recursively, the blocks of the children of its nodes
+		void freeNodeBlock(std::unique_ptr<QuadtreeNode[]> block);
+
+		// Snapshot of a node, rebuilt only if it changed since the last one
+		std::shared_ptr<const QuadtreeSnapshotNode> getSnapshotNode(QuadtreeNode* pNode);
+
+		// Occupants updated since beginBatch()
+		bool batching;
+		std::vector<QuadtreeOccupant*> batchOccupants;
+
+		void removeFromBatch(QuadtreeOccupant* oc);
+
 		// Called whenever something is removed, an action can be defined by derived classes
 		// Defaults to doing nothing
 		virtual void onRemoval() {}
 
-		void setQuadtree(QuadtreeOccupant* oc);
+		// Occupants of a bulk build, paired with the Morton code of their center
+		typedef std::pair<unsigned, QuadtreeOccupant*> BuildEntry;
+
+		// Number of levels (bits per axis) the Morton codes of a bulk build resolve
+		static const int mortonLevels = 16;
+
+		void buildNode(QuadtreeNode* pNode, std::vector<BuildEntry> &entries, size_t first, size_t last, int depth);
 
 		void recursiveCopy(QuadtreeNode* pThisNode, QuadtreeNode* pOtherNode, QuadtreeNode* pThisParent);
 
+		// Inherited from SpatialIndex
+		void update(QuadtreeOccupant* oc);
+		void remove(QuadtreeOccupant* oc);
+
 	public:
+		// Nodes partition once they would hold more than maxNumNodeOccupants, and merge their children back once
+		// fewer than minNumNodeOccupants are left below them. The gap between the two keeps occupants moving
+		// around a node boundary from partitioning and merging it over and over
 		size_t minNumNodeOccupants;
 		size_t maxNumNodeOccupants;
 		size_t maxLevels;
 
+		// Number of released child blocks kept for reuse, the rest is freed
+		size_t maxFreeNodeBlocks;
+
+		// Node regions are scaled up by this around their center (loose quadtree), so occupants are placed by their
+		// center and sink to the deepest node they fit in instead of staying in the node they straddle.
+		// Values of 1 (default) give a regular quadtree, 2 is the usual loose quadtree. Set before creating the tree
 		float oversizeMultiplier;
 
+		// If set, the region, point, shape and oriented rectangle queries add to queryStats. Defaults to false
+		bool countQueries;
+
+		QuadtreeQueryStats queryStats;
+
 		Quadtree();
-		Quadtree(const Quadtree &other) {
+		Quadtree(const Quadtree &other)
+			: SpatialIndex(other), batching(false)
+		{
 			*this = other;
 		}
 
@@ -46,12 +170,323 @@ namespace ltbl {
 
 		void pruneDeadReferences();
 
+		// Walks the whole tree, meant for tuning (minNumNodeOccupants, maxNumNodeOccupants, maxLevels, ...)
+		void getStats(QuadtreeStats &stats) const;
+
+		void resetQueryStats() {
+			queryStats = QuadtreeQueryStats();
+		}
+
+		// Frees the child blocks kept for reuse
+		void releaseFreeNodeBlocks() {
+			freeNodeBlocks.clear();
+			freeNodeBlocks.shrink_to_fit();
+		}
+
+		// Inherited from SpatialIndex.
+		// If the tree is empty, sorts the occupants by the Morton code of their centers within the root region,
+		// so that the occupants of every node form a contiguous range, and builds the nodes from the ranges in a
+		// single pass per level, without repartitioning or pushing down occupants. Otherwise adds them one by one
+		void bulkAdd(const std::vector<QuadtreeOccupant*> &occupants);
+
+		// Converts between the nominal region of a node and the one scaled by oversizeMultiplier
+		sf::FloatRect getLooseRegion(const sf::FloatRect &region) const;
+		sf::FloatRect getTightRegion(const sf::FloatRect &looseRegion) const;
+
+		// Batched updates. Between beginBatch() and commitBatch(), quadtreeUpdate() only records the occupant,
+		// the tree (and queries on it) still see the old positions.
+		// commitBatch() then reinserts all moved occupants in one pass, and partitions/merges only the nodes that
+		// were touched, once
+		void beginBatch();
+		void commitBatch();
+
+		bool isBatching() const {
+			return batching;
+		}
+
+		// Immutable view of the tree for other threads. Nodes that did not change since the previous snapshot are
+		// shared with it, so taking one costs about the number of changed nodes (plus copying outsideRoot).
+		// Call from the thread that updates the tree, the snapshot can then be queried from any thread.
+		// Occupant changes during a batch show up after commitBatch()
+		QuadtreeSnapshot getSnapshot();
+
+		// Inherited from SpatialIndex
 		void queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region);
 		void queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p);
 		void queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape);
+		void queryOrientedRect(std::vector<QuadtreeOccupant*> &result, const OrientedRect &orientedRect);
+
+		// Walks the tree once for all regions, only following the regions that overlap a node into it, so nearby
+		// regions share the visits of the nodes and occupants they have in common
+		void queryRegions(const std::vector<sf::FloatRect> &regions, std::vector<QuadtreeOccupant*> &result, std::vector<size_t> &resultStarts);
+
+		// Best first, visits nodes in order of distance until they are farther than the k-th closest occupant
+		void queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits);
+
+		bool rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit);
+		void rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits);
+
+		// Visitor queries, call visitor(QuadtreeOccupant*) for every result instead of filling a vector.
+		// These reuse an open list owned by the tree, so they do not allocate once it has grown to fit the tree,
+		// but they are not reentrant (the visitor may not query the same tree)
+		template<class Visitor>
+		void queryRegion(const sf::FloatRect &region, Visitor &&visitor) {
+			queryRegion(queryStack, region, std::forward<Visitor>(visitor));
+		}
+
+		template<class Visitor>
+		void queryPoint(const sf::Vector2f &p, Visitor &&visitor) {
+			queryPoint(queryStack, p, std::forward<Visitor>(visitor));
+		}
+
+		template<class Visitor>
+		void queryShape(const sf::ConvexShape &shape, Visitor &&visitor) {
+			queryShape(queryStack, shape, std::forward<Visitor>(visitor));
+		}
+
+		// Rotated rectangle query, tests nodes and occupants with orientedRectIntersection, so unlike queryShape it
+		// builds no shapes and does not allocate
+		template<class Visitor>
+		void queryOrientedRect(const OrientedRect &orientedRect, Visitor &&visitor) {
+			queryOrientedRect(queryStack, orientedRect, std::forward<Visitor>(visitor));
+		}
+
+		// Same as above, but use a caller supplied scratch open list (for nested or concurrent queries)
+		template<class Visitor>
+		void queryRegion(std::vector<QuadtreeNode*> &open, const sf::FloatRect &region, Visitor &&visitor);
+
+		template<class Visitor>
+		void queryPoint(std::vector<QuadtreeNode*> &open, const sf::Vector2f &p, Visitor &&visitor);
+
+		template<class Visitor>
+		void queryShape(std::vector<QuadtreeNode*> &open, const sf::ConvexShape &shape, Visitor &&visitor);
+
+		template<class Visitor>
+		void queryOrientedRect(std::vector<QuadtreeNode*> &open, const OrientedRect &orientedRect, Visitor &&visitor);
 
 		friend class QuadtreeNode;
 		friend class SceneObject;
 		friend class QuadtreeOccupant;
 	};
-}
+
+
+	template<class Visitor>
+	void Quadtree::queryRegion(std::vector<QuadtreeNode*> &open, const sf::FloatRect &region, Visitor &&visitor) {
+		QueryCounter counter(this);
+
+		// Query outside root elements
+		for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
+			QuadtreeOccupant* oc = *it;
+
+			counter.numOccupantsTested++;
+
+			if (oc != nullptr && region.intersects(oc->aabb)) {
+				// Intersects, visit
+				visitor(oc);
+
+				counter.numHits++;
+			}
+		}
+
+		if (pRootNode == nullptr)
+			return;
+
+		open.clear();
+
+		open.push_back(pRootNode.get());
+
+		while (!open.empty()) {
+			// Depth-first (results in less memory usage), remove objects from open list
+			QuadtreeNode* pCurrent = open.back();
+			open.pop_back();
+
+			counter.numNodesVisited++;
+
+			if (region.intersects(pCurrent->region)) {
+				counter.numOccupantsTested += pCurrent->occupants.size();
+
+				for (unsigned i = 0; i < pCurrent->occupants.size(); i++) {
+					QuadtreeOccupant* oc = pCurrent->occupants[i];
+
+					if (region.intersects(oc->aabb)) {
+						// Visible, visit
+						visitor(oc);
+
+						counter.numHits++;
+					}
+				}
+
+				// Add children to open list if they intersect the region
+				if (pCurrent->hasChildren)
+				for (int i = 0; i < 4; i++)
+				if (pCurrent->children[i].getNumOccupantsBelow() != 0)
+					open.push_back(&pCurrent->children[i]);
+			}
+		}
+	}
+
+	template<class Visitor>
+	void Quadtree::queryPoint(std::vector<QuadtreeNode*> &open, const sf::Vector2f &p, Visitor &&visitor) {
+		QueryCounter counter(this);
+
+		// Query outside root elements
+		for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
+			QuadtreeOccupant* oc = *it;
+
+			counter.numOccupantsTested++;
+
+			if (oc != nullptr && oc->aabb.contains(p)) {
+				// Intersects, visit
+				visitor(oc);
+
+				counter.numHits++;
+			}
+		}
+
+		if (pRootNode == nullptr)
+			return;
+
+		open.clear();
+
+		open.push_back(pRootNode.get());
+
+		while (!open.empty()) {
+			// Depth-first (results in less memory usage), remove objects from open list
+			QuadtreeNode* pCurrent = open.back();
+			open.pop_back();
+
+			counter.numNodesVisited++;
+
+			if (pCurrent->region.contains(p)) {
+				counter.numOccupantsTested += pCurrent->occupants.size();
+
+				for (unsigned i = 0; i < pCurrent->occupants.size(); i++) {
+					QuadtreeOccupant* oc = pCurrent->occupants[i];
+
+					if (oc->aabb.contains(p)) {
+						// Visible, visit
+						visitor(oc);
+
+						counter.numHits++;
+					}
+				}
+
+				// Add children to open list if they intersect the region
+				if (pCurrent->hasChildren)
+				for (int i = 0; i < 4; i++)
+				if (pCurrent->children[i].getNumOccupantsBelow() != 0)
+					open.push_back(&pCurrent->children[i]);
+			}
+		}
+	}
+
+	template<class Visitor>
+	void Quadtree::queryShape(std::vector<QuadtreeNode*> &open, const sf::ConvexShape &shape, Visitor &&visitor) {
+		QueryCounter counter(this);
+
+		// Query outside root elements
+		for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
+			QuadtreeOccupant* oc = *it;
+
+			counter.numOccupantsTested++;
+
+			if (oc != nullptr && shapeIntersection(shapeFromRect(oc->aabb), shape)) {
+				// Intersects, visit
+				visitor(oc);
+
+				counter.numHits++;
+			}
+		}
+
+		if (pRootNode == nullptr)
+			return;
+
+		open.clear();
+
+		open.push_back(pRootNode.get());
+
+		while (!open.empty()) {
+			// Depth-first (results in less memory usage), remove objects from open list
+			QuadtreeNode* pCurrent = open.back();
+			open.pop_back();
+
+			counter.numNodesVisited++;
+
+			if (shapeIntersection(shapeFromRect(pCurrent->region), shape)) {
+				counter.numOccupantsTested += pCurrent->occupants.size();
+
+				for (unsigned i = 0; i < pCurrent->occupants.size(); i++) {
+					QuadtreeOccupant* oc = pCurrent->occupants[i];
+
+					if (shapeIntersection(shapeFromRect(oc->aabb), shape)) {
+						// Visible, visit
+						visitor(oc);
+
+						counter.numHits++;
+					}
+				}
+
+				// Add children to open list if they intersect the region
+				if (pCurrent->hasChildren)
+				for (int i = 0; i < 4; i++)
+				if (pCurrent->children[i].getNumOccupantsBelow() != 0)
+					open.push_back(&pCurrent->children[i]);
+			}
+		}
+	}
+
+	template<class Visitor>
+	void Quadtree::queryOrientedRect(std::vector<QuadtreeNode*> &open, const OrientedRect &orientedRect, Visitor &&visitor) {
+		QueryCounter counter(this);
+
+		// Query outside root elements
+		for (std::unordered_set<QuadtreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++) {
+			QuadtreeOccupant* oc = *it;
+
+			counter.numOccupantsTested++;
+
+			if (oc != nullptr && orientedRectIntersection(orientedRect, oc->aabb)) {
+				// Intersects, visit
+				visitor(oc);
+
+				counter.numHits++;
+			}
+		}
+
+		if (pRootNode == nullptr)
+			return;
+
+		open.clear();
+
+		open.push_back(pRootNode.get());
+
+		while (!open.empty()) {
+			// Depth-first (results in less memory usage), remove objects from open list
+			QuadtreeNode* pCurrent = open.back();
+			open.pop_back();
+
+			counter.numNodesVisited++;
+
+			if (orientedRectIntersection(orientedRect, pCurrent->region)) {
+				counter.numOccupantsTested += pCurrent->occupants.size();
+
+				for (unsigned i = 0; i < pCurrent->occupants.size(); i++) {
+					QuadtreeOccupant* oc = pCurrent->occupants[i];
+
+					if (orientedRectIntersection(orientedRect, oc->aabb)) {
+						// Visible, visit
+						visitor(oc);
+
+						counter.numHits++;
+					}
+				}
+
+				// Add children to open list if they intersect the region
+				if (pCurrent->hasChildren)
+				for (int i = 0; i < 4; i++)
+				if (pCurrent->children[i].getNumOccupantsBelow() != 0)
+					open.push_back(&pCurrent->children[i]);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -8,7 +8,7 @@ using namespace ltbl;
 
 QuadtreeNode::QuadtreeNode(const sf::FloatRect &region, int level, QuadtreeNode* pParent, Quadtree* pQuadtree)
 :  pParent(pParent), pQuadtree(pQuadtree), hasChildren(false),  region(region), level(level),
-numOccupantsBelow(0)
+numOccupantsBelow(0), batchDirty(false), snapshotDirty(true)
 {}
 
 void QuadtreeNode::create(const sf::FloatRect &region, int level, QuadtreeNode* pParent, Quadtree* pQuadtree) {
@@ -18,12 +18,15 @@ void QuadtreeNode::create(const sf::FloatRect &region, int level, QuadtreeNode*
 	this->level = level;
 	this->pParent = pParent;
 	this->pQuadtree = pQuadtree;
+
+	pSnapshotNode.reset();
+	snapshotDirty = true;
 }
 
 void QuadtreeNode::getPossibleOccupantPosition(QuadtreeOccupant* oc, sf::Vector2i &point) {
 	// Compare the center of the AABB of the occupant to that of this node to determine
 	// which child it may (possibly, not certainly) fit in
-	const sf::Vector2f &occupantCenter = rectCenter(oc->getAABB());
+	const sf::Vector2f &occupantCenter = rectCenter(oc->aabb);
 	const sf::Vector2f &nodeRegionCenter = rectCenter(region);
 
 	point.x = occupantCenter.x > nodeRegionCenter.x ? 1 : 0;
@@ -31,12 +34,71 @@ void QuadtreeNode::getPossibleOccupantPosition(QuadtreeOccupant* oc, sf::Vector2
 }
 
 void QuadtreeNode::addToThisLevel(QuadtreeOccupant* oc) {
+	if (oc->pQuadtreeNode == this)
+		return;
+
+	insertOccupant(oc);
+}
+
+void QuadtreeNode::insertOccupant(QuadtreeOccupant* oc) {
+	markSnapshotDirty();
+
 	oc->pQuadtreeNode = this;
+	oc->nodeOccupantIndex = occupants.size();
 
-	if (occupants.find(oc) != occupants.end())
-		return;
+	occupants.push_back(oc);
+}
+
+void QuadtreeNode::eraseOccupant(QuadtreeOccupant* oc) {
+	assert(oc->pQuadtreeNode == this);
+	assert(occupants[oc->nodeOccupantIndex] == oc);
+
+	markSnapshotDirty();
+
+	// Swap with last, then shrink
+	QuadtreeOccupant* pLast = occupants.back();
+
+	occupants[oc->nodeOccupantIndex] = pLast;
+	pLast->nodeOccupantIndex = oc->nodeOccupantIndex;
+
+	occupants.pop_back();
+
+	oc->pQuadtreeNode = nullptr;
+}
 
-	occupants.insert(oc);
+void QuadtreeNode::moveFrom(QuadtreeNode &other, QuadtreeNode* pNewParent) {
+	pParent = pNewParent;
+	pQuadtree = other.pQuadtree;
+
+	region = other.region;
+	level = other.level;
+	numOccupantsBelow = other.numOccupantsBelow;
+
+	hasChildren = other.hasChildren;
+	children = std::move(other.children);
+	occupants = std::move(other.occupants);
+
+	// Fix back references
+	for (unsigned i = 0; i < occupants.size(); i++)
+		occupants[i]->pQuadtreeNode = this;
+
+	if (hasChildren)
+	for (int i = 0; i < 4; i++)
+		children[i].pParent = this;
+
+	batchDirty = other.batchDirty;
+
+	// Same contents, so the snapshot still holds
+	pSnapshotNode = std::move(other.pSnapshotNode);
+	snapshotDirty = other.snapshotDirty;
+
+	other.pSnapshotNode.reset();
+	other.snapshotDirty = true;
+
+	other.hasChildren = false;
+	other.batchDirty = false;
+	other.occupants.clear();
+	other.numOccupantsBelow = 0;
 }
 
 bool QuadtreeNode::addToChildren(QuadtreeOccupant* oc) {
@@ -46,10 +108,10 @@ bool QuadtreeNode::addToChildren(QuadtreeOccupant* oc) {
 
 	getPossibleOccupantPosition(oc, position);
 
-	QuadtreeNode* pChild = children[position.x + position.y * 2].get();
+	QuadtreeNode* pChild = &children[position.x + position.y * 2];
 
 	// See if the occupant fits in the child at the selected position
-	if (rectContains(pChild->region, oc->getAABB())) {
+	if (rectContains(pChild->region, oc->aabb)) {
 		// Fits, so can add to the child and finish
 		pChild->add(oc);
 
@@ -59,15 +121,47 @@ bool QuadtreeNode::addToChildren(QuadtreeOccupant* oc) {
 	return false;
 }
 
+QuadtreeNode* QuadtreeNode::getFittingChild(QuadtreeOccupant* oc) {
+	assert(hasChildren);
+
+	sf::Vector2i position;
+
+	getPossibleOccupantPosition(oc, position);
+
+	QuadtreeNode* pChild = &children[position.x + position.y * 2];
+
+	if (rectContains(pChild->region, oc->aabb))
+		return pChild;
+
+	return nullptr;
+}
+
+bool QuadtreeNode::canPartition() const {
+	return pQuadtree->pRootNode->level - level < static_cast<int>(pQuadtree->maxLevels);
+}
+
+void QuadtreeNode::destroyChildren() {
+	markSnapshotDirty();
+
+	pQuadtree->freeNodeBlock(std::move(children));
+
+	hasChildren = false;
+}
+
 void QuadtreeNode::partition() {
 	assert(!hasChildren);
 
-	sf::Vector2f halfRegionDims = rectHalfDims(region);
-	sf::Vector2f regionLowerBound = rectLowerBound(region);
-	sf::Vector2f regionCenter = rectCenter(region);
+	// Split the region the node had before it was scaled up by the oversize multiplier
+	sf::FloatRect tightRegion = pQuadtree->getTightRegion(region);
+
+	sf::Vector2f halfRegionDims = rectHalfDims(tightRegion);
+	sf::Vector2f regionLowerBound = rectLowerBound(tightRegion);
+	sf::Vector2f regionCenter = rectCenter(tightRegion);
 
 	int nextLowerLevel = level - 1;
 
+	children = pQuadtree->allocateNodeBlock();
+
 	for (int x = 0; x < 2; x++)
 	for (int y = 0; y < 2; y++) {
 		sf::Vector2f offset(x * halfRegionDims.x, y * halfRegionDims.y);
@@ -75,56 +169,60 @@ void QuadtreeNode::partition() {
 		sf::FloatRect childAABB = rectFromBounds(regionLowerBound + offset, regionCenter + offset);
 
 		// Scale up AABB by the oversize multiplier
-		sf::Vector2f newHalfDims = rectHalfDims(childAABB);
-		sf::Vector2f center = rectCenter(childAABB);
-		childAABB = rectFromBounds(center - newHalfDims, center + newHalfDims);
+		childAABB = pQuadtree->getLooseRegion(childAABB);
 
-		children[x + y * 2] = std::make_unique<QuadtreeNode>(childAABB, nextLowerLevel, this, pQuadtree);
+		children[x + y * 2].create(childAABB, nextLowerLevel, this, pQuadtree);
 	}
 
 	hasChildren = true;
+
+	markSnapshotDirty();
 }
 
-void QuadtreeNode::merge() {
-	if (hasChildren) {
-		// Place all occupants at lower levels into this node
-		getOccupants(occupants);
+void QuadtreeNode::pushDownOccupants() {
+	assert(hasChildren);
 
-		destroyChildren();
+	for (unsigned i = 0; i < occupants.size();) {
+		QuadtreeOccupant* oc = occupants[i];
+
+		QuadtreeNode* pChild = getFittingChild(oc);
+
+		if (pChild != nullptr) {
+			// Swaps the last occupant into i. Stays below this node, so numOccupantsBelow does not change
+			eraseOccupant(oc);
+
+			pChild->add(oc);
+		}
+		else
+			i++;
 	}
 }
 
-void QuadtreeNode::getOccupants(std::unordered_set<QuadtreeOccupant*> &occupants) {
-	// Iteratively parse subnodes in order to collect all occupants below this node
-	std::list<QuadtreeNode*> open;
+void QuadtreeNode::insertOccupantsBelow(QuadtreeNode* pTarget) {
+	for (int i = 0; i < 4; i++) {
+		QuadtreeNode &child = children[i];
 
-	open.push_back(this);
-
-	while (!open.empty()) {
-		// Depth-first (results in less memory usage), remove objects from open list
-		QuadtreeNode* pCurrent = open.back();
-		open.pop_back();
+		for (unsigned j = 0; j < child.occupants.size(); j++)
+			pTarget->insertOccupant(child.occupants[j]);
 
-		// Get occupants
-		for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++)
-		if ((*it) != nullptr) {
-			// Assign new node
-			(*it)->pQuadtreeNode = this;
+		if (child.hasChildren)
+			child.insertOccupantsBelow(pTarget);
+	}
+}
 
-			// Add to this node
-			occupants.insert(*it);
-		}
+void QuadtreeNode::merge() {
+	if (hasChildren) {
+		// Place all occupants at lower levels into this node. Recursive instead of using an open list, so that
+		// merging does not allocate (depth is limited by maxLevels)
+		insertOccupantsBelow(this);
 
-		// If the node has children, add them to the open list
-		if (pCurrent->hasChildren)
-		for (int i = 0; i < 4; i++)
-			open.push_back(pCurrent->children[i].get());
+		destroyChildren();
 	}
 }
 
 void QuadtreeNode::removeForDeletion(std::unordered_set<QuadtreeOccupant*> &occupants) {
 	// Iteratively parse subnodes in order to collect all occupants below this node
-	std::list<QuadtreeNode*> open;
+	std::vector<QuadtreeNode*> open;
 
 	open.push_back(this);
 
@@ -134,25 +232,26 @@ void QuadtreeNode::removeForDeletion(std::unordered_set<QuadtreeOccupant*> &occu
 		open.pop_back();
 
 		// Get occupants
-		for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++)
-		if ((*it) != nullptr) {
+		for (unsigned i = 0; i < pCurrent->occupants.size(); i++) {
 			// Since will be deleted, remove the reference
-			(*it)->pQuadtreeNode = nullptr;
+			pCurrent->occupants[i]->pQuadtreeNode = nullptr;
 
 			// Add to this node
-			occupants.insert(*it);
+			occupants.insert(pCurrent->occupants[i]);
 		}
 
+		pCurrent->occupants.clear();
+
 		// If the node has children, add them to the open list
 		if (pCurrent->hasChildren)
 		for (int i = 0; i < 4; i++)
-			open.push_back(pCurrent->children[i].get());
+			open.push_back(&pCurrent->children[i]);
 	}
 }
 
 void QuadtreeNode::getAllOccupantsBelow(std::vector<QuadtreeOccupant*> &occupants) {
 	// Iteratively parse subnodes in order to collect all occupants below this node
-	std::list<QuadtreeNode*> open;
+	std::vector<QuadtreeNode*> open;
 
 	open.push_back(this);
 
@@ -162,21 +261,18 @@ void QuadtreeNode::getAllOccupantsBelow(std::vector<QuadtreeOccupant*> &occupant
 		open.pop_back();
 
 		// Get occupants
-		for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++)
-		if ((*it) != nullptr)
-			// Add to this node
-			occupants.push_back(*it);
+		occupants.insert(occupants.end(), pCurrent->occupants.begin(), pCurrent->occupants.end());
 
 		// If the node has children, add them to the open list
 		if (pCurrent->hasChildren)
 		for (int i = 0; i < 4; i++)
-			open.push_back(pCurrent->children[i].get());
+			open.push_back(&pCurrent->children[i]);
 	}
 }
 
 void QuadtreeNode::getAllOccupantsBelow(std::unordered_set<QuadtreeOccupant*> &occupants) {
 	// Iteratively parse subnodes in order to collect all occupants below this node
-	std::list<QuadtreeNode*> open;
+	std::vector<QuadtreeNode*> open;
 
 	open.push_back(this);
 
@@ -186,15 +282,12 @@ void QuadtreeNode::getAllOccupantsBelow(std::unordered_set<QuadtreeOccupant*> &o
 		open.pop_back();
 
 		// Get occupants
-		for (std::unordered_set<QuadtreeOccupant*>::iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++)
-		if ((*it) == nullptr)
-			// Add to this node
-			occupants.insert(*it);
+		occupants.insert(pCurrent->occupants.begin(), pCurrent->occupants.end());
 
 		// If the node has children, add them to the open list
 		if (pCurrent->hasChildren)
 		for (int i = 0; i < 4; i++)
-			open.push_back(pCurrent->children[i].get());
+			open.push_back(&pCurrent->children[i]);
 	}
 }
 
@@ -202,9 +295,8 @@ void QuadtreeNode::update(QuadtreeOccupant* oc) {
 	if (oc == nullptr)
 		return;
 
-	if (!occupants.empty())
-		// Remove, may be re-added to this node later
-		occupants.erase(oc);
+	// Remove, may be re-added to this node later
+	eraseOccupant(oc);
 
 	// Propogate upwards, looking for a node that has room (the current one may still have room)
 	QuadtreeNode* pNode = this;
@@ -213,7 +305,7 @@ void QuadtreeNode::update(QuadtreeOccupant* oc) {
 		pNode->numOccupantsBelow--;
 
 		// If has room for 1 more, found a spot
-		if (rectContains(pNode->region, oc->getAABB()))
+		if (rectContains(pNode->region, oc->aabb))
 			break;
 
 		pNode = pNode->pParent;
@@ -227,36 +319,32 @@ void QuadtreeNode::update(QuadtreeOccupant* oc) {
 			return;
 
 		pQuadtree->outsideRoot.insert(oc);
-
-		oc->pQuadtreeNode = nullptr;
 	}
 	else // Add to the selected node
 		pNode->add(oc);
 }
 
 void QuadtreeNode::remove(QuadtreeOccupant* oc) {
-	assert(!occupants.empty());
+	assert(oc != nullptr);
 
 	// Remove from node
-	occupants.erase(oc);
-
-	if (oc == nullptr)
-		return;
+	eraseOccupant(oc);
 
-	// Propogate upwards, merging if there are enough occupants in the node
+	// Propogate upwards, finding the highest node that has too few occupants left below it
 	QuadtreeNode* pNode = this;
+	QuadtreeNode* pMergeNode = nullptr;
 
 	while (pNode != nullptr) {
 		pNode->numOccupantsBelow--;
 
-		if (pNode->numOccupantsBelow >= pQuadtree->minNumNodeOccupants) {
-			pNode->merge();
-
-			break;
-		}
+		if (pNode->hasChildren && pNode->numOccupantsBelow < pQuadtree->minNumNodeOccupants)
+			pMergeNode = pNode;
 
 		pNode = pNode->pParent;
 	}
+
+	if (pMergeNode != nullptr)
+		pMergeNode->merge();
 }
 
 void QuadtreeNode::add(QuadtreeOccupant* oc) {
@@ -271,9 +359,12 @@ void QuadtreeNode::add(QuadtreeOccupant* oc) {
 	}
 	else {
 		// Check if we need a new partition
-		if (occupants.size() >= pQuadtree->maxNumNodeOccupants && level < pQuadtree->maxLevels) {
+		if (occupants.size() >= pQuadtree->maxNumNodeOccupants && canPartition()) {
 			partition();
 
+			// Let the occupants already here sink as well
+			pushDownOccupants();
+
 			if (addToChildren(oc))
 				return;
 		}
@@ -283,15 +374,84 @@ void QuadtreeNode::add(QuadtreeOccupant* oc) {
 	addToThisLevel(oc);
 }
 
+void QuadtreeNode::markBatchDirty() {
+	// Stop at the first node that is already marked, its ancestors are as well
+	QuadtreeNode* pNode = this;
+
+	while (pNode != nullptr && !pNode->batchDirty) {
+		pNode->batchDirty = true;
+
+		pNode = pNode->pParent;
+	}
+}
+
+void QuadtreeNode::markSnapshotDirty() {
+	// Stop at the first node that is already marked, its ancestors are as well
+	QuadtreeNode* pNode = this;
+
+	while (pNode != nullptr && !pNode->snapshotDirty) {
+		pNode->snapshotDirty = true;
+
+		pNode = pNode->pParent;
+	}
+}
+
+void QuadtreeNode::settleBatch() {
+	batchDirty = false;
+
+	// Partition if over full, then push down the occupants that fit in the new children
+	if (!hasChildren && occupants.size() > pQuadtree->maxNumNodeOccupants && canPartition()) {
+		partition();
+
+		for (unsigned i = 0; i < occupants.size();) {
+			QuadtreeOccupant* oc = occupants[i];
+
+			QuadtreeNode* pChild = getFittingChild(oc);
+
+			if (pChild != nullptr) {
+				// Swaps the last occupant into i
+				eraseOccupant(oc);
+
+				pChild->insertOccupant(oc);
+				pChild->batchDirty = true;
+			}
+			else
+				i++;
+		}
+	}
+
+	numOccupantsBelow = occupants.size();
+
+	if (hasChildren) {
+		for (int i = 0; i < 4; i++) {
+			if (children[i].batchDirty)
+				children[i].settleBatch();
+
+			numOccupantsBelow += children[i].numOccupantsBelow;
+		}
+
+		// Merge if too few occupants are left below
+		if (numOccupantsBelow < pQuadtree->minNumNodeOccupants)
+			merge();
+	}
+}
+
 void QuadtreeNode::pruneDeadReferences() {
-	for (std::unordered_set<QuadtreeOccupant*>::iterator it = occupants.begin(); it != occupants.end();) {
-		if ((*it) == nullptr)
-			it++;
+	for (unsigned i = 0; i < occupants.size();) {
+		if (occupants[i] == nullptr) {
+			markSnapshotDirty();
+
+			occupants[i] = occupants.back();
+			occupants.pop_back();
+
+			if (i < occupants.size() && occupants[i] != nullptr)
+				occupants[i]->nodeOccupantIndex = i;
+		}
 		else
-			it = occupants.erase(it);
+			i++;
 	}
 
 	if (hasChildren)
 	for (int i = 0; i < 4; i++)
-		children[i]->pruneDeadReferences();
+		children[i].pruneDeadReferences();
 }
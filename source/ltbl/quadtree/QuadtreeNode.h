@@ -1,9 +1,11 @@
 #pragma once
 
 #include "QuadtreeOccupant.h"
+#include "QuadtreeSnapshot.h"
 
 #include <memory>
 #include <array>
+#include <vector>
 #include <unordered_set>
 
 namespace ltbl {
@@ -14,16 +16,22 @@ namespace ltbl {
 
 		bool hasChildren;
 
-		std::array<std::unique_ptr<QuadtreeNode>, 4> children;
+		// The 4 children are allocated as one contiguous block, indexed x + y * 2 (Morton order)
+		std::unique_ptr<QuadtreeNode[]> children;
 
-		std::unordered_set<QuadtreeOccupant*> occupants;
+		// Flat occupant array. Each occupant stores its index in it, so removal is a swap with the last element
+		std::vector<QuadtreeOccupant*> occupants;
 
 		sf::FloatRect region;
 
-		unsigned level;
+		// Levels count down from the root (children are one level lower), so may be negative
+		int level;
 
 		unsigned numOccupantsBelow;
 
+		// Set on nodes whose occupants changed during a batch commit, and on all their ancestors
+		bool batchDirty;
+
 		void getPossibleOccupantPosition(QuadtreeOccupant* oc, sf::Vector2i &point);
 
 		void addToThisLevel(QuadtreeOccupant* oc);
@@ -31,17 +39,29 @@ namespace ltbl {
 		// Returns true if occupant was added to children
 		bool addToChildren(QuadtreeOccupant* oc);
 
-		void destroyChildren() {
-			for (int i = 0; i < 4; i++)
-				children[i].reset();
+		// Returns the child the occupant fits in, or nullptr if it does not fit in one
+		QuadtreeNode* getFittingChild(QuadtreeOccupant* oc);
 
-			hasChildren = false;
-		}
+		// Whether the node is less than maxLevels below the root
+		bool canPartition() const;
+
+		void insertOccupant(QuadtreeOccupant* oc);
+		void eraseOccupant(QuadtreeOccupant* oc);
 
-		void getOccupants(std::unordered_set<QuadtreeOccupant*> &occupants);
+		// Gives the children back to the pool of the tree
+		void destroyChildren();
+
+		// Takes over the region, children and occupants of another node, leaving it empty
+		void moveFrom(QuadtreeNode &other, QuadtreeNode* pNewParent);
 
 		void partition();
 
+		// Moves the occupants of this level into the children they fit in
+		void pushDownOccupants();
+
+		// Inserts the occupants of all nodes below this one into pTarget
+		void insertOccupantsBelow(QuadtreeNode* pTarget);
+
 		void merge();
 
 		void update(QuadtreeOccupant* oc);
@@ -49,9 +69,22 @@ namespace ltbl {
 
 		void removeForDeletion(std::unordered_set<QuadtreeOccupant*> &occupants);
 
+		void markBatchDirty();
+
+		// Snapshot of this node (and everything below it), still valid if not snapshotDirty
+		std::shared_ptr<const QuadtreeSnapshotNode> pSnapshotNode;
+
+		// Set on nodes whose occupants or children changed since the last snapshot, and on all their ancestors
+		bool snapshotDirty;
+
+		void markSnapshotDirty();
+
+		// Recomputes occupant counts and partitions/merges the dirty part of the tree below this node
+		void settleBatch();
+
 	public:
 		QuadtreeNode()
-			: hasChildren(false), numOccupantsBelow(0)
+			: pParent(nullptr), pQuadtree(nullptr), hasChildren(false), level(0), numOccupantsBelow(0), batchDirty(false), snapshotDirty(true)
 		{}
 
 		QuadtreeNode(const sf::FloatRect &region, int level, QuadtreeNode* pParent, class Quadtree* pQuadtree);
@@ -1,26 +1,24 @@
 #include "QuadtreeOccupant.h"
 
-#include "QuadtreeNode.h"
-
-#include "Quadtree.h"
+#include "SpatialIndex.h"
 
 #include <assert.h>
 
 using namespace ltbl;
 
 void QuadtreeOccupant::quadtreeUpdate() {
-	if (pQuadtreeNode != nullptr)
-		pQuadtreeNode->update(this);
-	else {
-		pQuadtree->outsideRoot.erase(this);
+	if (pSpatialIndex != nullptr)
+		pSpatialIndex->update(this);
+}
 
-		pQuadtree->add(this);
+void QuadtreeOccupant::quadtreeRemove() {
+	if (pSpatialIndex != nullptr) {
+		pSpatialIndex->remove(this);
+
+		pSpatialIndex = nullptr;
 	}
 }
 
-void QuadtreeOccupant::quadtreeRemove() {
-	if (pQuadtreeNode != nullptr)
-		pQuadtreeNode->remove(this);
-	else
-		pQuadtree->outsideRoot.erase(this);
+bool QuadtreeOccupant::rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, float &distance) const {
+	return rayRectIntersection(aabb, start, sf::Vector2f(1.0f / direction.x, 1.0f / direction.y), maxDistance, distance);
 }
\ No newline at end of file
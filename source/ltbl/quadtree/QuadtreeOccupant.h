@@ -13,11 +13,34 @@ namespace ltbl {
 	class QuadtreeOccupant {
 	private:
 		class QuadtreeNode* pQuadtreeNode;
-		class Quadtree* pQuadtree;
+		class SpatialIndex* pSpatialIndex;
+
+		// Index in the occupant array of pQuadtreeNode
+		unsigned nodeOccupantIndex;
+
+		// Index in the pending update list of the tree while it is batching, -1 if not pending
+		int batchIndex;
+
+		// Leaf node index when in a DynamicAABBTree, -1 otherwise
+		int aabbTreeLeaf;
+
+		// World space AABB as of the last add or quadtreeUpdate(), read by the tree instead of calling getAABB()
+		sf::FloatRect aabb;
+
+		void updateAABB() {
+			aabb = getAABB();
+
+			onAABBUpdate();
+		}
+
+	protected:
+		// Called whenever the tree reads the AABB (on add and quadtreeUpdate()), for derived classes that cache
+		// things the update may have changed
+		virtual void onAABBUpdate() {}
 
 	public:
 		QuadtreeOccupant()
-			: pQuadtreeNode(nullptr), pQuadtree(nullptr)
+			: pQuadtreeNode(nullptr), pSpatialIndex(nullptr), nodeOccupantIndex(0), batchIndex(-1), aabbTreeLeaf(-1)
 		{}
 
 		void quadtreeUpdate();
@@ -25,9 +48,21 @@ namespace ltbl {
 
 		virtual sf::FloatRect getAABB() const = 0;
 
+		const sf::FloatRect &getCachedAABB() const {
+			return aabb;
+		}
+
+		// Exact test for ray casts (SpatialIndex::rayCast), direction is normalized.
+		// On a hit, sets distance to where the ray enters the occupant (0 if it starts inside).
+		// Defaults to the cached AABB
+		virtual bool rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, float &distance) const;
+
+		friend class SpatialIndex;
 		friend class Quadtree;
 		friend class QuadtreeNode;
 		friend class DynamicQuadtree;
 		friend class StaticQuadtree;
+		friend class DynamicAABBTree;
+		friend class SpatialHashGrid;
 	};
 }
\ No newline at end of file
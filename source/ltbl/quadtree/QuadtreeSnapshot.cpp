@@ -0,0 +1,15 @@
+#include "QuadtreeSnapshot.h"
+
+using namespace ltbl;
+
+void QuadtreeSnapshot::queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) const {
+	std::vector<const QuadtreeSnapshotNode*> open;
+
+	queryRegion(open, region, [&result](const QuadtreeSnapshotEntry &entry) { result.push_back(entry.pOccupant); });
+}
+
+void QuadtreeSnapshot::queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p) const {
+	std::vector<const QuadtreeSnapshotNode*> open;
+
+	queryPoint(open, p, [&result](const QuadtreeSnapshotEntry &entry) { result.push_back(entry.pOccupant); });
+}
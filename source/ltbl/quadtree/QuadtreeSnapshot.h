@@ -0,0 +1,118 @@
+#pragma once
+
+#include "QuadtreeOccupant.h"
+
+#include <memory>
+#include <vector>
+
+namespace ltbl {
+	// An occupant with the AABB it had when the snapshot was taken
+	struct QuadtreeSnapshotEntry {
+		QuadtreeOccupant* pOccupant;
+		sf::FloatRect aabb;
+	};
+
+	// Immutable copy of a QuadtreeNode. Nodes that did not change between snapshots are shared by them
+	struct QuadtreeSnapshotNode {
+		sf::FloatRect region;
+
+		std::vector<QuadtreeSnapshotEntry> occupants;
+
+		// All null if the node has no children
+		std::shared_ptr<const QuadtreeSnapshotNode> children[4];
+	};
+
+	// Read only view of a Quadtree as of Quadtree::getSnapshot().
+	// Snapshots never change, so any number of threads can query them without locks while the tree is updated.
+	// Queries only read the snapshot, the occupants they return are not protected, so only use them as handles
+	class QuadtreeSnapshot {
+	private:
+		std::shared_ptr<const QuadtreeSnapshotNode> pRootNode;
+
+		std::shared_ptr<const std::vector<QuadtreeSnapshotEntry>> outsideRoot;
+
+	public:
+		QuadtreeSnapshot() {}
+
+		QuadtreeSnapshot(const std::shared_ptr<const QuadtreeSnapshotNode> &pRootNode, const std::shared_ptr<const std::vector<QuadtreeSnapshotEntry>> &outsideRoot)
+			: pRootNode(pRootNode), outsideRoot(outsideRoot)
+		{}
+
+		bool empty() const {
+			return pRootNode == nullptr && (outsideRoot == nullptr || outsideRoot->empty());
+		}
+
+		void queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) const;
+		void queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p) const;
+
+		// Visitor queries, call visitor(const QuadtreeSnapshotEntry &) for every result.
+		// Take a scratch open list, so every thread can reuse its own
+		template<class Visitor>
+		void queryRegion(std::vector<const QuadtreeSnapshotNode*> &open, const sf::FloatRect &region, Visitor &&visitor) const;
+
+		template<class Visitor>
+		void queryPoint(std::vector<const QuadtreeSnapshotNode*> &open, const sf::Vector2f &p, Visitor &&visitor) const;
+	};
+
+	template<class Visitor>
+	void QuadtreeSnapshot::queryRegion(std::vector<const QuadtreeSnapshotNode*> &open, const sf::FloatRect &region, Visitor &&visitor) const {
+		if (outsideRoot != nullptr)
+		for (std::vector<QuadtreeSnapshotEntry>::const_iterator it = outsideRoot->begin(); it != outsideRoot->end(); it++)
+		if (region.intersects(it->aabb))
+			visitor(*it);
+
+		if (pRootNode == nullptr)
+			return;
+
+		open.clear();
+
+		open.push_back(pRootNode.get());
+
+		while (!open.empty()) {
+			const QuadtreeSnapshotNode* pCurrent = open.back();
+			open.pop_back();
+
+			if (!region.intersects(pCurrent->region))
+				continue;
+
+			for (std::vector<QuadtreeSnapshotEntry>::const_iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++)
+			if (region.intersects(it->aabb))
+				visitor(*it);
+
+			if (pCurrent->children[0] != nullptr)
+			for (int i = 0; i < 4; i++)
+				open.push_back(pCurrent->children[i].get());
+		}
+	}
+
+	template<class Visitor>
+	void QuadtreeSnapshot::queryPoint(std::vector<const QuadtreeSnapshotNode*> &open, const sf::Vector2f &p, Visitor &&visitor) const {
+		if (outsideRoot != nullptr)
+		for (std::vector<QuadtreeSnapshotEntry>::const_iterator it = outsideRoot->begin(); it != outsideRoot->end(); it++)
+		if (it->aabb.contains(p))
+			visitor(*it);
+
+		if (pRootNode == nullptr)
+			return;
+
+		open.clear();
+
+		open.push_back(pRootNode.get());
+
+		while (!open.empty()) {
+			const QuadtreeSnapshotNode* pCurrent = open.back();
+			open.pop_back();
+
+			if (!pCurrent->region.contains(p))
+				continue;
+
+			for (std::vector<QuadtreeSnapshotEntry>::const_iterator it = pCurrent->occupants.begin(); it != pCurrent->occupants.end(); it++)
+			if (it->aabb.contains(p))
+				visitor(*it);
+
+			if (pCurrent->children[0] != nullptr)
+			for (int i = 0; i < 4; i++)
+				open.push_back(pCurrent->children[i].get());
+		}
+	}
+}
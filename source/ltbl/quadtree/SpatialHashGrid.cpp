@@ -0,0 +1,220 @@
+#include "SpatialHashGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <assert.h>
+
+using namespace ltbl;
+
+namespace {
+	// Clamped, so huge or infinite regions (rays) do not overflow
+	int getCellCoordinate(float x) {
+		const float maxCoordinate = 1073741824.0f;
+
+		return static_cast<int>(std::min(std::max(std::floor(x), -maxCoordinate), maxCoordinate));
+	}
+}
+
+void SpatialHashGrid::getCellRange(const sf::FloatRect &aabb, sf::Vector2i &lowerBound, sf::Vector2i &upperBound) const {
+	float cellSizeInv = 1.0f / cellSize;
+
+	lowerBound.x = getCellCoordinate(aabb.left * cellSizeInv);
+	lowerBound.y = getCellCoordinate(aabb.top * cellSizeInv);
+	upperBound.x = getCellCoordinate((aabb.left + aabb.width) * cellSizeInv);
+	upperBound.y = getCellCoordinate((aabb.top + aabb.height) * cellSizeInv);
+}
+
+sf::Vector2i SpatialHashGrid::getCell(const sf::Vector2f &p) const {
+	float cellSizeInv = 1.0f / cellSize;
+
+	return sf::Vector2i(getCellCoordinate(p.x * cellSizeInv), getCellCoordinate(p.y * cellSizeInv));
+}
+
+void SpatialHashGrid::addToCells(QuadtreeOccupant* oc, const sf::Vector2i &lowerBound, const sf::Vector2i &upperBound) {
+	for (int x = lowerBound.x; x <= upperBound.x; x++)
+	for (int y = lowerBound.y; y <= upperBound.y; y++)
+		cells[getCellKey(x, y)].push_back(oc);
+}
+
+void SpatialHashGrid::removeFromCells(QuadtreeOccupant* oc, const sf::Vector2i &lowerBound, const sf::Vector2i &upperBound) {
+	for (int x = lowerBound.x; x <= upperBound.x; x++)
+	for (int y = lowerBound.y; y <= upperBound.y; y++) {
+		std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::iterator cellIt = cells.find(getCellKey(x, y));
+
+		assert(cellIt != cells.end());
+
+		std::vector<QuadtreeOccupant*> &cell = cellIt->second;
+
+		// Cells are small, find and swap with the last element
+		std::vector<QuadtreeOccupant*>::iterator it = std::find(cell.begin(), cell.end(), oc);
+
+		assert(it != cell.end());
+
+		*it = cell.back();
+		cell.pop_back();
+
+		if (cell.empty())
+			cells.erase(cellIt);
+	}
+}
+
+void SpatialHashGrid::add(QuadtreeOccupant* oc) {
+	setSpatialIndex(oc);
+
+	oc->updateAABB();
+
+	sf::Vector2i lowerBound, upperBound;
+
+	getCellRange(oc->aabb, lowerBound, upperBound);
+
+	addToCells(oc, lowerBound, upperBound);
+}
+
+void SpatialHashGrid::update(QuadtreeOccupant* oc) {
+	// The cached AABB is still the one the occupant was stored with
+	sf::Vector2i oldLowerBound, oldUpperBound;
+
+	getCellRange(oc->aabb, oldLowerBound, oldUpperBound);
+
+	oc->updateAABB();
+
+	sf::Vector2i lowerBound, upperBound;
+
+	getCellRange(oc->aabb, lowerBound, upperBound);
+
+	// Still covers the same cells, nothing to do
+	if (lowerBound == oldLowerBound && upperBound == oldUpperBound)
+		return;
+
+	removeFromCells(oc, oldLowerBound, oldUpperBound);
+	addToCells(oc, lowerBound, upperBound);
+}
+
+void SpatialHashGrid::remove(QuadtreeOccupant* oc) {
+	sf::Vector2i lowerBound, upperBound;
+
+	getCellRange(oc->aabb, lowerBound, upperBound);
+
+	removeFromCells(oc, lowerBound, upperBound);
+}
+
+void SpatialHashGrid::clear() {
+	for (std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::iterator cellIt = cells.begin(); cellIt != cells.end(); cellIt++)
+	for (std::vector<QuadtreeOccupant*>::iterator it = cellIt->second.begin(); it != cellIt->second.end(); it++)
+		(*it)->pSpatialIndex = nullptr;
+
+	cells.clear();
+}
+
+void SpatialHashGrid::queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) {
+	queryRegion(region, [&result](QuadtreeOccupant* oc) { result.push_back(oc); });
+}
+
+void SpatialHashGrid::queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p) {
+	sf::Vector2i cellPosition = getCell(p);
+
+	std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::const_iterator cellIt = cells.find(getCellKey(cellPosition.x, cellPosition.y));
+
+	if (cellIt == cells.end())
+		return;
+
+	// A point is in a single cell, so no duplicates
+	for (std::vector<QuadtreeOccupant*>::const_iterator it = cellIt->second.begin(); it != cellIt->second.end(); it++)
+	if ((*it)->aabb.contains(p))
+		result.push_back(*it);
+}
+
+void SpatialHashGrid::addNearestInCell(const std::vector<QuadtreeOccupant*> &cell, const sf::Vector2i &cellPosition, const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits, size_t first) const {
+	for (std::vector<QuadtreeOccupant*>::const_iterator it = cell.begin(); it != cell.end(); it++) {
+		sf::Vector2f center = rectCenter((*it)->aabb);
+
+		if (getCell(center) == cellPosition)
+			addNearest(hits, first, k, *it, vectorMagnitude(center - p));
+	}
+}
+
+void SpatialHashGrid::queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits) {
+	if (cells.empty() || k == 0)
+		return;
+
+	size_t first = hits.size();
+
+	sf::Vector2i center = getCell(p);
+
+	// Rings of cells at increasing (Chebyshev) cell distance from the cell of p.
+	// Centers in ring r + 1 or beyond are at least r cells away
+	for (int r = 0;; r++) {
+		// Ring larger than the whole grid, finish with the cells that are not in the searched rings
+		if (8.0 * r >= cells.size()) {
+			for (std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::const_iterator cellIt = cells.begin(); cellIt != cells.end(); cellIt++) {
+				sf::Vector2i cellPosition = getCellPosition(cellIt->first);
+
+				if (std::abs(cellPosition.x - center.x) >= r || std::abs(cellPosition.y - center.y) >= r)
+					addNearestInCell(cellIt->second, cellPosition, p, k, hits, first);
+			}
+
+			break;
+		}
+
+		auto visitCell = [&](int x, int y) {
+			std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::const_iterator cellIt = cells.find(getCellKey(x, y));
+
+			if (cellIt != cells.end())
+				addNearestInCell(cellIt->second, sf::Vector2i(x, y), p, k, hits, first);
+		};
+
+		if (r == 0)
+			visitCell(center.x, center.y);
+		else {
+			// Border of the square, top and bottom rows, then the left and right columns between them
+			for (int x = center.x - r; x <= center.x + r; x++) {
+				visitCell(x, center.y - r);
+				visitCell(x, center.y + r);
+			}
+
+			for (int y = center.y - r + 1; y <= center.y + r - 1; y++) {
+				visitCell(center.x - r, y);
+				visitCell(center.x + r, y);
+			}
+		}
+
+		if (getNearestBound(hits, first, k) <= r * cellSize)
+			break;
+	}
+
+	sortNearest(hits, first);
+}
+
+void SpatialHashGrid::rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits) {
+	if (cells.empty())
+		return;
+
+	if (std::isinf(maxDistance)) {
+		// Bounds of the occupied cells
+		sf::Vector2i lowerBound = getCellPosition(cells.begin()->first);
+		sf::Vector2i upperBound = lowerBound;
+
+		for (std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::const_iterator cellIt = cells.begin(); cellIt != cells.end(); cellIt++) {
+			sf::Vector2i cellPosition = getCellPosition(cellIt->first);
+
+			lowerBound.x = std::min(lowerBound.x, cellPosition.x);
+			lowerBound.y = std::min(lowerBound.y, cellPosition.y);
+			upperBound.x = std::max(upperBound.x, cellPosition.x);
+			upperBound.y = std::max(upperBound.y, cellPosition.y);
+		}
+
+		sf::FloatRect bounds = rectFromBounds(sf::Vector2f(lowerBound.x, lowerBound.y) * cellSize, sf::Vector2f(upperBound.x + 1, upperBound.y + 1) * cellSize);
+
+		// The ray has left the bounds once it is past the farthest corner
+		maxDistance = 0.0f;
+
+		for (int i = 0; i < 4; i++) {
+			sf::Vector2f corner(i % 2 == 0 ? bounds.left : bounds.left + bounds.width, i / 2 == 0 ? bounds.top : bounds.top + bounds.height);
+
+			maxDistance = std::max(maxDistance, vectorMagnitude(corner - start));
+		}
+	}
+
+	SpatialIndex::rayCastAll(start, direction, maxDistance, hits);
+}
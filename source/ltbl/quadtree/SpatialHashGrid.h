@@ -0,0 +1,124 @@
+#pragma once
+
+#include "SpatialIndex.h"
+
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace ltbl {
+	// Uniform grid of square cells, stored sparsely in a hash map, an alternative to DynamicQuadtree for dense
+	// occluders of about the same size (tiles). Occupants are stored in every cell their AABB overlaps.
+	// Adding, updating and removing only touch those cells, queries only the cells covered by the query region.
+	// There is no root region, so nothing needs trimming
+	class SpatialHashGrid : public SpatialIndex {
+	private:
+		std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>> cells;
+
+		static unsigned long long getCellKey(int x, int y) {
+			return (static_cast<unsigned long long>(static_cast<unsigned>(x)) << 32) | static_cast<unsigned>(y);
+		}
+
+		static sf::Vector2i getCellPosition(unsigned long long key) {
+			return sf::Vector2i(static_cast<int>(static_cast<unsigned>(key >> 32)), static_cast<int>(static_cast<unsigned>(key)));
+		}
+
+		// Reports an occupant of the cell at cellPosition if it overlaps region, and only from the first cell both cover
+		template<class Visitor>
+		void visitCell(const std::vector<QuadtreeOccupant*> &cell, const sf::Vector2i &cellPosition, const sf::FloatRect &region, const sf::Vector2i &lowerBound, Visitor &visitor) const;
+
+		// Inclusive range of cells covered by an AABB
+		void getCellRange(const sf::FloatRect &aabb, sf::Vector2i &lowerBound, sf::Vector2i &upperBound) const;
+
+		void addToCells(QuadtreeOccupant* oc, const sf::Vector2i &lowerBound, const sf::Vector2i &upperBound);
+		void removeFromCells(QuadtreeOccupant* oc, const sf::Vector2i &lowerBound, const sf::Vector2i &upperBound);
+
+		sf::Vector2i getCell(const sf::Vector2f &p) const;
+
+		// Adds the occupants of a cell whose centers are in it to the k-nearest candidates
+		void addNearestInCell(const std::vector<QuadtreeOccupant*> &cell, const sf::Vector2i &cellPosition, const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits, size_t first) const;
+
+	protected:
+		// Inherited from SpatialIndex
+		void update(QuadtreeOccupant* oc);
+		void remove(QuadtreeOccupant* oc);
+
+	public:
+		// Side length of a cell, about the size of the occupants works best. Set before adding occupants
+		float cellSize;
+
+		SpatialHashGrid()
+			: cellSize(64.0f)
+		{}
+
+		SpatialHashGrid(float cellSize)
+			: cellSize(cellSize)
+		{}
+
+		// Inherited from SpatialIndex
+		void add(QuadtreeOccupant* oc);
+
+		void clear();
+
+		void queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region);
+		void queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p);
+
+		// Searches rings of cells around p, each occupant is only considered from the cell its center is in
+		void queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits);
+
+		// Infinite rays are cut off where they leave the occupied cells
+		void rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits);
+
+		// Visitor query, same as the one of Quadtree
+		template<class Visitor>
+		void queryRegion(const sf::FloatRect &region, Visitor &&visitor);
+
+		size_t getNumCells() const {
+			return cells.size();
+		}
+	};
+
+	template<class Visitor>
+	void SpatialHashGrid::visitCell(const std::vector<QuadtreeOccupant*> &cell, const sf::Vector2i &cellPosition, const sf::FloatRect &region, const sf::Vector2i &lowerBound, Visitor &visitor) const {
+		for (std::vector<QuadtreeOccupant*>::const_iterator it = cell.begin(); it != cell.end(); it++) {
+			QuadtreeOccupant* oc = *it;
+
+			if (!region.intersects(oc->aabb))
+				continue;
+
+			sf::Vector2i ocLowerBound, ocUpperBound;
+
+			getCellRange(oc->aabb, ocLowerBound, ocUpperBound);
+
+			if (cellPosition.x == std::max(lowerBound.x, ocLowerBound.x) && cellPosition.y == std::max(lowerBound.y, ocLowerBound.y))
+				visitor(oc);
+		}
+	}
+
+	template<class Visitor>
+	void SpatialHashGrid::queryRegion(const sf::FloatRect &region, Visitor &&visitor) {
+		sf::Vector2i lowerBound, upperBound;
+
+		getCellRange(region, lowerBound, upperBound);
+
+		// Walk the covered cells, or all cells if there are fewer of those (huge regions)
+		if (static_cast<double>(upperBound.x - lowerBound.x + 1) * static_cast<double>(upperBound.y - lowerBound.y + 1) <= cells.size()) {
+			for (int x = lowerBound.x; x <= upperBound.x; x++)
+			for (int y = lowerBound.y; y <= upperBound.y; y++) {
+				std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::const_iterator cellIt = cells.find(getCellKey(x, y));
+
+				if (cellIt != cells.end())
+					visitCell(cellIt->second, sf::Vector2i(x, y), region, lowerBound, visitor);
+			}
+		}
+		else {
+			for (std::unordered_map<unsigned long long, std::vector<QuadtreeOccupant*>>::const_iterator cellIt = cells.begin(); cellIt != cells.end(); cellIt++) {
+				sf::Vector2i cellPosition = getCellPosition(cellIt->first);
+
+				if (cellPosition.x >= lowerBound.x && cellPosition.x <= upperBound.x && cellPosition.y >= lowerBound.y && cellPosition.y <= upperBound.y)
+					visitCell(cellIt->second, cellPosition, region, lowerBound, visitor);
+			}
+		}
+	}
+}
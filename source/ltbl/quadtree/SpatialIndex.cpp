@@ -0,0 +1,164 @@
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <assert.h>
+
+using namespace ltbl;
+
+namespace {
+	bool nearestHitLess(const NearestHit &left, const NearestHit &right) {
+		return left.distance < right.distance;
+	}
+}
+
+void SpatialIndex::addNearest(std::vector<NearestHit> &hits, size_t first, size_t k, QuadtreeOccupant* oc, float distance) {
+	NearestHit hit;
+
+	hit.pOccupant = oc;
+	hit.distance = distance;
+
+	if (hits.size() - first < k) {
+		hits.push_back(hit);
+
+		std::push_heap(hits.begin() + first, hits.end(), nearestHitLess);
+	}
+	else if (k != 0 && distance < hits[first].distance) {
+		// Replace the farthest
+		std::pop_heap(hits.begin() + first, hits.end(), nearestHitLess);
+
+		hits.back() = hit;
+
+		std::push_heap(hits.begin() + first, hits.end(), nearestHitLess);
+	}
+}
+
+float SpatialIndex::getNearestBound(const std::vector<NearestHit> &hits, size_t first, size_t k) {
+	if (k == 0)
+		return 0.0f;
+
+	if (hits.size() - first < k)
+		return std::numeric_limits<float>::infinity();
+
+	return hits[first].distance;
+}
+
+void SpatialIndex::sortNearest(std::vector<NearestHit> &hits, size_t first) {
+	std::sort_heap(hits.begin() + first, hits.end(), nearestHitLess);
+}
+
+void SpatialIndex::bulkAdd(const std::vector<QuadtreeOccupant*> &occupants) {
+	for (std::vector<QuadtreeOccupant*>::const_iterator it = occupants.begin(); it != occupants.end(); it++)
+		add(*it);
+}
+
+void SpatialIndex::queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape) {
+	size_t first = result.size();
+
+	queryRegion(result, shape.getGlobalBounds());
+
+	// Keep the ones that actually intersect the shape
+	size_t last = first;
+
+	for (size_t i = first; i < result.size(); i++)
+	if (shapeIntersection(shapeFromRect(result[i]->getCachedAABB()), shape))
+		result[last++] = result[i];
+
+	result.resize(last);
+}
+
+void SpatialIndex::queryOrientedRect(std::vector<QuadtreeOccupant*> &result, const OrientedRect &orientedRect) {
+	size_t first = result.size();
+
+	queryRegion(result, orientedRect.bounds);
+
+	// Keep the ones that actually intersect the rectangle
+	size_t last = first;
+
+	for (size_t i = first; i < result.size(); i++)
+	if (orientedRectIntersection(orientedRect, result[i]->getCachedAABB()))
+		result[last++] = result[i];
+
+	result.resize(last);
+}
+
+bool SpatialIndex::rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit) {
+	std::vector<RayCastHit> hits;
+
+	rayCastAll(start, direction, maxDistance, hits);
+
+	if (hits.empty())
+		return false;
+
+	hit = hits.front();
+
+	return true;
+}
+
+void SpatialIndex::rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits) {
+	assert(!std::isinf(maxDistance));
+
+	sf::Vector2f normalizedDirection = vectorNormalize(direction);
+
+	// Per component, so an infinite ray along an axis does not give NaN (0 * infinity)
+	sf::Vector2f end(normalizedDirection.x == 0.0f ? start.x : start.x + normalizedDirection.x * maxDistance,
+		normalizedDirection.y == 0.0f ? start.y : start.y + normalizedDirection.y * maxDistance);
+
+	// Padded, region queries do not find anything with an empty (axis aligned ray) region
+	sf::Vector2f padding(1.0f, 1.0f);
+
+	std::vector<QuadtreeOccupant*> result;
+
+	queryRegion(result, rectFromBounds(sf::Vector2f(std::min(start.x, end.x), std::min(start.y, end.y)) - padding, sf::Vector2f(std::max(start.x, end.x), std::max(start.y, end.y)) + padding));
+
+	size_t first = hits.size();
+
+	for (size_t i = 0; i < result.size(); i++) {
+		RayCastHit hit;
+
+		if (result[i]->rayCast(start, normalizedDirection, maxDistance, hit.distance)) {
+			hit.pOccupant = result[i];
+
+			hits.push_back(hit);
+		}
+	}
+
+	std::sort(hits.begin() + first, hits.end(), [](const RayCastHit &left, const RayCastHit &right) {
+		return left.distance < right.distance;
+	});
+}
+
+void SpatialIndex::queryRegions(const std::vector<sf::FloatRect> &regions, std::vector<QuadtreeOccupant*> &result, std::vector<size_t> &resultStarts) {
+	resultStarts.clear();
+
+	for (size_t i = 0; i < regions.size(); i++) {
+		resultStarts.push_back(result.size());
+
+		queryRegion(result, regions[i]);
+	}
+
+	resultStarts.push_back(result.size());
+}
+
+void SpatialIndex::queryRadius(const sf::Vector2f &p, float radius, std::vector<NearestHit> &hits) {
+	std::vector<QuadtreeOccupant*> result;
+
+	// Centers in the circle are in the square, so their AABBs intersect it
+	queryRegion(result, rectFromBounds(p - sf::Vector2f(radius, radius), p + sf::Vector2f(radius, radius)));
+
+	size_t first = hits.size();
+
+	for (size_t i = 0; i < result.size(); i++) {
+		NearestHit hit;
+
+		hit.pOccupant = result[i];
+		hit.distance = vectorMagnitude(rectCenter(result[i]->getCachedAABB()) - p);
+
+		if (hit.distance <= radius)
+			hits.push_back(hit);
+	}
+
+	std::sort(hits.begin() + first, hits.end(), nearestHitLess);
+}
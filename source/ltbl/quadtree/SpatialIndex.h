@@ -0,0 +1,98 @@
+#pragma once
+
+#include "QuadtreeOccupant.h"
+
+#include <vector>
+
+namespace ltbl {
+	struct RayCastHit {
+		QuadtreeOccupant* pOccupant;
+
+		// Along the ray, from its start
+		float distance;
+	};
+
+	struct NearestHit {
+		QuadtreeOccupant* pOccupant;
+
+		// From the query point to the center of the AABB of the occupant
+		float distance;
+	};
+
+	// Base class for containers of QuadtreeOccupants (the quadtrees, DynamicAABBTree, SpatialHashGrid).
+	// LightSystem only uses this interface, so the container used for shapes and lights can be chosen
+	class SpatialIndex {
+	protected:
+		void setSpatialIndex(QuadtreeOccupant* oc) {
+			oc->pSpatialIndex = this;
+		}
+
+		// Called by QuadtreeOccupant::quadtreeUpdate() and quadtreeRemove()
+		virtual void update(QuadtreeOccupant* oc) = 0;
+		virtual void remove(QuadtreeOccupant* oc) = 0;
+
+		// Helpers for k-nearest queries. hits[first, end) holds the closest candidates so far as a max heap on distance
+		static void addNearest(std::vector<NearestHit> &hits, size_t first, size_t k, QuadtreeOccupant* oc, float distance);
+
+		// Distance of the farthest of the k closest, infinity while there are fewer than k
+		static float getNearestBound(const std::vector<NearestHit> &hits, size_t first, size_t k);
+
+		// Turns the heap into a list sorted by distance
+		static void sortNearest(std::vector<NearestHit> &hits, size_t first);
+
+	public:
+		virtual ~SpatialIndex() {}
+
+		virtual void add(QuadtreeOccupant* oc) = 0;
+
+		// Adds many occupants at once (level load). Defaults to calling add() for each
+		virtual void bulkAdd(const std::vector<QuadtreeOccupant*> &occupants);
+
+		virtual void clear() = 0;
+
+		// Restructures the container, meant to be called about once per frame. Defaults to doing nothing
+		virtual void trim() {}
+
+		// Defers quadtreeUpdate() calls until commitBatch(). Defaults to updating immediately
+		virtual void beginBatch() {}
+		virtual void commitBatch() {}
+
+		virtual void queryRegion(std::vector<QuadtreeOccupant*> &result, const sf::FloatRect &region) = 0;
+		virtual void queryPoint(std::vector<QuadtreeOccupant*> &result, const sf::Vector2f &p) = 0;
+
+		// Many region queries at once (the AABBs of all visible lights). The occupants overlapping regions[i] are
+		// added to result, at [resultStarts[i], resultStarts[i + 1]). resultStarts is overwritten.
+		// Defaults to a region query per region
+		virtual void queryRegions(const std::vector<sf::FloatRect> &regions, std::vector<QuadtreeOccupant*> &result, std::vector<size_t> &resultStarts);
+
+		// Defaults to a region query on the bounds of the shape, then testing the AABBs of the results
+		virtual void queryShape(std::vector<QuadtreeOccupant*> &result, const sf::ConvexShape &shape);
+
+		// Defaults to a region query on the bounds of the rectangle, then testing the AABBs of the results
+		virtual void queryOrientedRect(std::vector<QuadtreeOccupant*> &result, const OrientedRect &orientedRect);
+
+		// Ray casts, tested with QuadtreeOccupant::rayCast. direction does not need to be normalized, distances are
+		// world units along it. rayCast() returns the closest hit, rayCastAll() adds all hits sorted by distance.
+		// Default to a region query on the bounds of the ray, so maxDistance must be finite for those
+		virtual bool rayCast(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, RayCastHit &hit);
+		virtual void rayCastAll(const sf::Vector2f &start, const sf::Vector2f &direction, float maxDistance, std::vector<RayCastHit> &hits);
+
+		// Same as the ray casts, from start to end
+		bool segmentCast(const sf::Vector2f &start, const sf::Vector2f &end, RayCastHit &hit) {
+			return rayCast(start, end - start, vectorMagnitude(end - start), hit);
+		}
+
+		void segmentCastAll(const sf::Vector2f &start, const sf::Vector2f &end, std::vector<RayCastHit> &hits) {
+			rayCastAll(start, end - start, vectorMagnitude(end - start), hits);
+		}
+
+		// Nearest occupants, by distance from p to the centers of their AABBs (the positions of lights).
+		// queryNearest() adds the (up to) k closest, queryRadius() all within radius, both sorted by distance
+		virtual void queryNearest(const sf::Vector2f &p, size_t k, std::vector<NearestHit> &hits) = 0;
+
+		// Defaults to a region query on the square around the circle
+		virtual void queryRadius(const sf::Vector2f &p, float radius, std::vector<NearestHit> &hits);
+
+		friend class QuadtreeOccupant;
+	};
+}
@@ -7,10 +7,12 @@ using namespace ltbl;
 void StaticQuadtree::add(QuadtreeOccupant* oc) {
 	assert(created());
 
-	setQuadtree(oc);
+	setSpatialIndex(oc);
+
+	oc->updateAABB();
 
 	// If the occupant fits in the root node
-	if (rectContains(pRootNode->getRegion(), oc->getAABB()))
+	if (rectContains(pRootNode->getRegion(), oc->aabb))
 		pRootNode->add(oc);
 	else
 		outsideRoot.insert(oc);
@@ -8,7 +8,7 @@ namespace ltbl {
 	public:
 		StaticQuadtree() {}
 		StaticQuadtree(const sf::FloatRect &rootRegion) {
-			pRootNode = std::make_unique<QuadtreeNode>(rootRegion, 0, nullptr, this);
+			pRootNode = std::make_unique<QuadtreeNode>(getLooseRegion(rootRegion), 0, nullptr, this);
 		}
 
 		StaticQuadtree(const StaticQuadtree &other) : Quadtree(other) {
@@ -20,7 +20,7 @@ namespace ltbl {
 		}
 
 		void create(const sf::FloatRect &rootRegion) {
-			pRootNode = std::make_unique<QuadtreeNode>(rootRegion, 0, nullptr, this);
+			pRootNode = std::make_unique<QuadtreeNode>(getLooseRegion(rootRegion), 0, nullptr, this);
 		}
 
 		// Inherited from Quadtree
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ltbl/quadtree/QuadtreeOccupant.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace ltbl {
+	// Occupant that is only an AABB, like a tile or a sprite
+	class BenchmarkBox : public QuadtreeOccupant {
+	public:
+		sf::FloatRect rect;
+
+		sf::FloatRect getAABB() const {
+			return rect;
+		}
+	};
+
+	inline std::mt19937 &getBenchmarkGenerator() {
+		static std::mt19937 generator(1234);
+
+		return generator;
+	}
+
+	inline float benchmarkRandom(float low, float high) {
+		return std::uniform_real_distribution<float>(low, high)(getBenchmarkGenerator());
+	}
+
+	// Boxes of sizes from minSize to maxSize, spread over region
+	inline void getBenchmarkBoxes(std::vector<BenchmarkBox> &boxes, size_t numBoxes, const sf::FloatRect &region, float minSize, float maxSize) {
+		boxes.resize(numBoxes);
+
+		for (size_t i = 0; i < numBoxes; i++)
+			boxes[i].rect = sf::FloatRect(benchmarkRandom(region.left, region.left + region.width), benchmarkRandom(region.top, region.top + region.height),
+				benchmarkRandom(minSize, maxSize), benchmarkRandom(minSize, maxSize));
+	}
+
+	// Average milliseconds of numRepeats calls of f
+	template<class Function>
+	double benchmarkMilliseconds(int numRepeats, Function f) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < numRepeats; i++)
+			f();
+
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / numRepeats;
+	}
+}
@@ -0,0 +1,62 @@
+// Building quadtrees of 20000 to 500000 occupants with bulkAdd, and with add one occupant at a time
+
+#include "BenchmarkCommon.h"
+
+#include "ltbl/quadtree/StaticQuadtree.h"
+#include "ltbl/quadtree/DynamicQuadtree.h"
+
+#include <iostream>
+#include <cmath>
+
+using namespace ltbl;
+
+namespace {
+	template<class QuadtreeType>
+	void benchmark(const char* treeName, std::vector<BenchmarkBox> &boxes, const sf::FloatRect &rootRegion) {
+		std::vector<QuadtreeOccupant*> occupants(boxes.size());
+
+		for (size_t i = 0; i < boxes.size(); i++)
+			occupants[i] = &boxes[i];
+
+		QuadtreeType bulkTree(rootRegion);
+
+		double bulkMilliseconds = benchmarkMilliseconds(1, [&]() {
+			bulkTree.bulkAdd(occupants);
+		});
+
+		for (size_t i = 0; i < boxes.size(); i++)
+			boxes[i].quadtreeRemove();
+
+		QuadtreeType incrementalTree(rootRegion);
+
+		double incrementalMilliseconds = benchmarkMilliseconds(1, [&]() {
+			for (size_t i = 0; i < occupants.size(); i++)
+				incrementalTree.add(occupants[i]);
+		});
+
+		for (size_t i = 0; i < boxes.size(); i++)
+			boxes[i].quadtreeRemove();
+
+		std::cout << treeName << ", " << boxes.size() << " occupants: bulkAdd " << bulkMilliseconds << " ms, add " << incrementalMilliseconds << " ms" << std::endl;
+	}
+}
+
+int main() {
+	const size_t numOccupants[] = { 20000, 100000, 500000 };
+
+	for (int n = 0; n < 3; n++) {
+		// Same density of occupants for every count
+		float halfSize = 1000.0f * std::sqrt(numOccupants[n] / 20000.0f);
+
+		sf::FloatRect rootRegion(-halfSize, -halfSize, 2.0f * halfSize, 2.0f * halfSize);
+
+		std::vector<BenchmarkBox> boxes;
+
+		getBenchmarkBoxes(boxes, numOccupants[n], rootRegion, 1.0f, 30.0f);
+
+		benchmark<StaticQuadtree>("StaticQuadtree", boxes, rootRegion);
+		benchmark<DynamicQuadtree>("DynamicQuadtree", boxes, rootRegion);
+	}
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Edges per second classifyFacingPoint classifies with every kernel the CPU supports, for shapes of a few sizes.
+// Like LightSystem::getPenumbrasPoint, edges are classified in chunks of 64
+
+#include "ltbl/lighting/FacingKernel.h"
+
+#include <chrono>
+#include <iostream>
+#include <cmath>
+
+using namespace ltbl;
+
+namespace {
+	const char* kernelNames[] = { "scalar", "SSE", "AVX" };
+
+	const int chunkSize = 64;
+
+	// Circle of numPoints points
+	void getCircle(ShapePointsSoA &shape, int numPoints) {
+		std::vector<sf::Vector2f> points(numPoints);
+		std::vector<sf::Vector2f> normals(numPoints);
+
+		for (int i = 0; i < numPoints; i++) {
+			float angle = 2.0f * pi * i / numPoints;
+
+			points[i] = sf::Vector2f(std::cos(angle), std::sin(angle)) * 100.0f;
+		}
+
+		for (int i = 0; i < numPoints; i++) {
+			sf::Vector2f pointToNextPoint = points[(i + 1) % numPoints] - points[i];
+
+			normals[i] = vectorNormalize(sf::Vector2f(-pointToNextPoint.y, pointToNextPoint.x));
+		}
+
+		shape.assign(points, normals);
+	}
+}
+
+int main() {
+	const int sizes[] = { 16, 64, 256, 4096 };
+
+	// Edges classified per kernel and size
+	const int numEdges = 50000000;
+
+	std::cout << "Supported: " << kernelNames[getSupportedFacingKernelType()] << ", default: " << kernelNames[getFacingKernelType()] << std::endl;
+
+	FacingKernelType defaultType = getFacingKernelType();
+
+	for (int s = 0; s < 4; s++) {
+		int numPoints = sizes[s];
+
+		ShapePointsSoA shape;
+
+		getCircle(shape, numPoints);
+
+		std::vector<unsigned char> facing(chunkSize);
+
+		for (int k = FacingKernelScalar; k <= getSupportedFacingKernelType(); k++) {
+			setFacingKernelType(static_cast<FacingKernelType>(k));
+
+			int numRepeats = numEdges / numPoints;
+
+			// Keeps the results used
+			unsigned checksum = 0;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			for (int r = 0; r < numRepeats; r++) {
+				// The source moves a little every time, as lights do
+				sf::Vector2f sourceCenter(300.0f + r * 0.001f, 20.0f);
+
+				for (int first = 0; first < numPoints; first += chunkSize) {
+					int last = std::min(first + chunkSize, numPoints);
+
+					classifyFacingPoint(shape, first, last, sourceCenter, 10.0f, facing.data());
+
+					checksum += facing[0];
+				}
+			}
+
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::cout << numPoints << " points, " << kernelNames[k] << ": " << numRepeats * static_cast<double>(numPoints) / seconds / 1.0e6 << " M edges/s (" << checksum << ")" << std::endl;
+		}
+	}
+
+	setFacingKernelType(defaultType);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+// Depth of the occupants and work of region queries in a regular (oversizeMultiplier 1) and a loose
+// (oversizeMultiplier 2) quadtree, on the same occupants and queries
+
+#include "BenchmarkCommon.h"
+
+#include "ltbl/quadtree/DynamicQuadtree.h"
+
+#include <iostream>
+
+using namespace ltbl;
+
+int main() {
+	sf::FloatRect rootRegion(-2000.0f, -2000.0f, 4000.0f, 4000.0f);
+
+	std::vector<BenchmarkBox> boxes;
+
+	getBenchmarkBoxes(boxes, 50000, rootRegion, 1.0f, 60.0f);
+
+	std::vector<sf::FloatRect> queryRegions(10000);
+
+	for (size_t i = 0; i < queryRegions.size(); i++)
+		queryRegions[i] = sf::FloatRect(benchmarkRandom(-2000.0f, 2000.0f), benchmarkRandom(-2000.0f, 2000.0f), benchmarkRandom(10.0f, 600.0f), benchmarkRandom(10.0f, 600.0f));
+
+	const float oversizeMultipliers[] = { 1.0f, 2.0f };
+
+	for (int m = 0; m < 2; m++) {
+		DynamicQuadtree quadtree;
+
+		quadtree.oversizeMultiplier = oversizeMultipliers[m];
+		quadtree.create(rootRegion);
+
+		for (size_t i = 0; i < boxes.size(); i++)
+			quadtree.add(&boxes[i]);
+
+		QuadtreeStats stats;
+
+		quadtree.getStats(stats);
+
+		std::vector<QuadtreeOccupant*> result;
+
+		quadtree.countQueries = true;
+
+		for (size_t i = 0; i < queryRegions.size(); i++) {
+			result.clear();
+
+			quadtree.queryRegion(result, queryRegions[i]);
+		}
+
+		quadtree.countQueries = false;
+
+		double milliseconds = benchmarkMilliseconds(5, [&]() {
+			for (size_t i = 0; i < queryRegions.size(); i++) {
+				result.clear();
+
+				quadtree.queryRegion(result, queryRegions[i]);
+			}
+		});
+
+		const QuadtreeQueryStats &queryStats = quadtree.queryStats;
+
+		std::cout << "oversizeMultiplier " << oversizeMultipliers[m] << ": average occupant depth " << stats.averageOccupantDepth << ", max depth " << stats.maxDepth
+			<< ", " << stats.numNodes << " nodes" << std::endl;
+
+		std::cout << "    per query: " << static_cast<double>(queryStats.numNodesVisited) / queryStats.numQueries << " nodes visited, "
+			<< static_cast<double>(queryStats.numOccupantsTested) / queryStats.numQueries << " occupants tested, "
+			<< static_cast<double>(queryStats.numHits) / queryStats.numQueries << " hits, " << milliseconds * 1000.0 / queryRegions.size() << " us" << std::endl;
+
+		for (size_t i = 0; i < boxes.size(); i++)
+			boxes[i].quadtreeRemove();
+	}
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+// Checks ray casts that run along the edges of boxes, the usual case in tile levels, on all containers.
+// Rays along an edge hit the box (either edge) at the right distance, and boxes behind the start are not hit.
+// Fails if any check does not hold
+
+#include "ltbl/quadtree/StaticQuadtree.h"
+#include "ltbl/quadtree/DynamicQuadtree.h"
+#include "ltbl/quadtree/DynamicAABBTree.h"
+#include "ltbl/quadtree/SpatialHashGrid.h"
+#include "ltbl/lighting/LightShape.h"
+
+#include <iostream>
+#include <cmath>
+
+using namespace ltbl;
+
+namespace {
+	class Box : public QuadtreeOccupant {
+	public:
+		sf::FloatRect rect;
+
+		Box(const sf::FloatRect &rect)
+			: rect(rect)
+		{}
+
+		sf::FloatRect getAABB() const {
+			return rect;
+		}
+	};
+
+	int numFailures = 0;
+
+	void expect(bool condition, const char* indexName, const char* what) {
+		if (!condition) {
+			std::cerr << indexName << ": " << what << std::endl;
+
+			numFailures++;
+		}
+	}
+
+	// All hits of a cast along direction from start, which should be the boxes at expectedDistances (sorted)
+	void checkCast(SpatialIndex &index, const char* indexName, const sf::Vector2f &start, const sf::Vector2f &direction, const std::vector<float> &expectedDistances, const char* what) {
+		std::vector<RayCastHit> hits;
+
+		index.rayCastAll(start, direction, 1000.0f, hits);
+
+		bool same = hits.size() == expectedDistances.size();
+
+		for (size_t i = 0; same && i < hits.size(); i++)
+			same = std::abs(hits[i].distance - expectedDistances[i]) < 0.001f;
+
+		expect(same, indexName, what);
+
+		RayCastHit hit;
+
+		bool anyHit = index.rayCast(start, direction, 1000.0f, hit);
+
+		expect(anyHit == !expectedDistances.empty() && (!anyHit || std::abs(hit.distance - expectedDistances.front()) < 0.001f), indexName, what);
+	}
+
+	void checkIndex(SpatialIndex &index, const char* indexName) {
+		// Column of boxes from x 0 to 10, every 20 units from y 0 on. The ray starts at y -5
+		std::vector<Box> column;
+
+		for (int i = 0; i < 10; i++)
+			column.push_back(Box(sf::FloatRect(0.0f, i * 20.0f, 10.0f, 10.0f)));
+
+		for (size_t i = 0; i < column.size(); i++)
+			index.add(&column[i]);
+
+		std::vector<float> columnDistances;
+
+		for (size_t i = 0; i < column.size(); i++)
+			columnDistances.push_back(5.0f + i * 20.0f);
+
+		checkCast(index, indexName, sf::Vector2f(0.0f, -5.0f), sf::Vector2f(0.0f, 1.0f), columnDistances, "ray along the left edges");
+		checkCast(index, indexName, sf::Vector2f(10.0f, -5.0f), sf::Vector2f(0.0f, 1.0f), columnDistances, "ray along the right edges");
+		checkCast(index, indexName, sf::Vector2f(5.0f, -5.0f), sf::Vector2f(0.0f, 1.0f), columnDistances, "ray through the middle");
+		checkCast(index, indexName, sf::Vector2f(10.5f, -5.0f), sf::Vector2f(0.0f, 1.0f), std::vector<float>(), "ray next to the edges");
+
+		// Along the top edge of the first box, both ways
+		checkCast(index, indexName, sf::Vector2f(-5.0f, 0.0f), sf::Vector2f(1.0f, 0.0f), std::vector<float>(1, 5.0f), "ray along a top edge");
+		checkCast(index, indexName, sf::Vector2f(15.0f, 10.0f), sf::Vector2f(-1.0f, 0.0f), std::vector<float>(1, 5.0f), "ray back along a bottom edge");
+
+		// The column is behind the start
+		checkCast(index, indexName, sf::Vector2f(0.0f, 500.0f), sf::Vector2f(0.0f, 1.0f), std::vector<float>(), "boxes behind the ray");
+		checkCast(index, indexName, sf::Vector2f(5.0f, 500.0f), sf::Vector2f(0.0f, 1.0f), std::vector<float>(), "boxes behind the ray");
+
+		// Wall tiles from x 64 to 128, next to the column, hit by rays along either side
+		std::vector<LightShape> walls(4);
+
+		for (size_t i = 0; i < walls.size(); i++) {
+			walls[i].shape = shapeFromRect(sf::FloatRect(64.0f, 64.0f * i, 64.0f, 64.0f));
+
+			index.add(&walls[i]);
+		}
+
+		std::vector<float> wallDistances;
+
+		for (size_t i = 0; i < walls.size(); i++)
+			wallDistances.push_back(10.0f + 64.0f * i);
+
+		checkCast(index, indexName, sf::Vector2f(64.0f, -10.0f), sf::Vector2f(0.0f, 1.0f), wallDistances, "ray along the left sides of wall tiles");
+		checkCast(index, indexName, sf::Vector2f(128.0f, -10.0f), sf::Vector2f(0.0f, 1.0f), wallDistances, "ray along the right sides of wall tiles");
+
+		index.clear();
+	}
+}
+
+int main() {
+	sf::FloatRect rootRegion(-1000.0f, -1000.0f, 2000.0f, 2000.0f);
+
+	StaticQuadtree staticQuadtree(rootRegion);
+	DynamicQuadtree dynamicQuadtree(rootRegion);
+	DynamicAABBTree aabbTree;
+	SpatialHashGrid hashGrid(64.0f);
+
+	checkIndex(staticQuadtree, "StaticQuadtree");
+	checkIndex(dynamicQuadtree, "DynamicQuadtree");
+	checkIndex(aabbTree, "DynamicAABBTree");
+	checkIndex(hashGrid, "SpatialHashGrid");
+
+	std::cout << numFailures << " failures" << std::endl;
+
+	return numFailures == 0 ? 0 : 1;
+}
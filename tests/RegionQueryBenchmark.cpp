@@ -0,0 +1,72 @@
+// Finding the shapes of 500 overlapping point lights among 20000 shapes, like LightSystem::render, with one
+// queryRegion per light and with one queryRegions for all of them, on every container
+
+#include "BenchmarkCommon.h"
+
+#include "ltbl/quadtree/DynamicQuadtree.h"
+#include "ltbl/quadtree/DynamicAABBTree.h"
+#include "ltbl/quadtree/SpatialHashGrid.h"
+
+#include <iostream>
+
+using namespace ltbl;
+
+namespace {
+	void benchmark(SpatialIndex &index, const char* indexName, std::vector<BenchmarkBox> &boxes, const std::vector<sf::FloatRect> &lightRegions) {
+		for (size_t i = 0; i < boxes.size(); i++)
+			index.add(&boxes[i]);
+
+		std::vector<QuadtreeOccupant*> result;
+		std::vector<size_t> resultStarts;
+
+		auto queryPerLight = [&]() {
+			result.clear();
+
+			for (size_t l = 0; l < lightRegions.size(); l++)
+				index.queryRegion(result, lightRegions[l]);
+		};
+
+		auto queryBatched = [&]() {
+			result.clear();
+
+			index.queryRegions(lightRegions, result, resultStarts);
+		};
+
+		// Once untimed each, so both start with warm caches and scratch lists
+		queryPerLight();
+		queryBatched();
+
+		size_t numPairs = result.size();
+
+		double perLightMilliseconds = benchmarkMilliseconds(20, queryPerLight);
+		double batchedMilliseconds = benchmarkMilliseconds(20, queryBatched);
+
+		std::cout << indexName << ": " << numPairs << " light-shape pairs, queryRegion per light " << perLightMilliseconds << " ms, queryRegions " << batchedMilliseconds << " ms" << std::endl;
+
+		index.clear();
+	}
+}
+
+int main() {
+	sf::FloatRect worldRegion(-4000.0f, -4000.0f, 8000.0f, 8000.0f);
+
+	std::vector<BenchmarkBox> boxes;
+
+	getBenchmarkBoxes(boxes, 20000, worldRegion, 4.0f, 60.0f);
+
+	// Lights of radius 300 in a 2000 by 1200 view, so they overlap a lot
+	std::vector<sf::FloatRect> lightRegions(500);
+
+	for (size_t l = 0; l < lightRegions.size(); l++)
+		lightRegions[l] = sf::FloatRect(benchmarkRandom(-1000.0f, 1000.0f) - 300.0f, benchmarkRandom(-600.0f, 600.0f) - 300.0f, 600.0f, 600.0f);
+
+	DynamicQuadtree quadtree(worldRegion);
+	DynamicAABBTree aabbTree;
+	SpatialHashGrid hashGrid(64.0f);
+
+	benchmark(quadtree, "DynamicQuadtree", boxes, lightRegions);
+	benchmark(aabbTree, "DynamicAABBTree", boxes, lightRegions);
+	benchmark(hashGrid, "SpatialHashGrid", boxes, lightRegions);
+
+	return 0;
+}
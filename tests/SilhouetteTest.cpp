@@ -0,0 +1,185 @@
+// Checks that binary searching the silhouette of convex shapes (getFacingBoundaries) finds the same boundaries as
+// classifying every edge, on random convex polygons, degenerate polygons and lights inside or touching the shapes.
+// Fails if any differ
+
+#include "ltbl/lighting/Silhouette.h"
+#include "ltbl/lighting/FacingKernel.h"
+
+#include <iostream>
+#include <random>
+
+using namespace ltbl;
+
+namespace {
+	std::mt19937 generator(1234);
+
+	float randomRange(float low, float high) {
+		return std::uniform_real_distribution<float>(low, high)(generator);
+	}
+
+	int randomInt(int low, int high) {
+		return std::uniform_int_distribution<int>(low, high)(generator);
+	}
+
+	// Normals the way LightShape computes them
+	void getNormals(const std::vector<sf::Vector2f> &points, std::vector<sf::Vector2f> &normals) {
+		normals.resize(points.size());
+
+		for (size_t i = 0; i < points.size(); i++) {
+			sf::Vector2f pointToNextPoint = points[(i + 1) % points.size()] - points[i];
+
+			normals[i] = vectorNormalize(sf::Vector2f(-pointToNextPoint.y, pointToNextPoint.x));
+		}
+	}
+
+	// Points on an ellipse at sorted random (or even) angles, in either winding, starting at a random point
+	void getEllipse(std::vector<sf::Vector2f> &points, int numPoints, const sf::Vector2f &center, const sf::Vector2f &radii, bool evenAngles) {
+		std::vector<float> angles(numPoints);
+
+		for (int i = 0; i < numPoints; i++)
+			angles[i] = evenAngles ? 2.0f * pi * i / numPoints : randomRange(0.0f, 2.0f * pi);
+
+		std::sort(angles.begin(), angles.end());
+
+		float rotation = randomRange(0.0f, 2.0f * pi);
+		float winding = randomInt(0, 1) == 0 ? 1.0f : -1.0f;
+
+		points.resize(numPoints);
+
+		for (int i = 0; i < numPoints; i++) {
+			sf::Vector2f offset(std::cos(winding * angles[i]) * radii.x, std::sin(winding * angles[i]) * radii.y);
+
+			points[i] = center + sf::Vector2f(offset.x * std::cos(rotation) - offset.y * std::sin(rotation), offset.x * std::sin(rotation) + offset.y * std::cos(rotation));
+		}
+
+		std::rotate(points.begin(), points.begin() + randomInt(0, numPoints - 1), points.end());
+	}
+
+	// Rectangle with many collinear points on every side
+	void getSubdividedRectangle(std::vector<sf::Vector2f> &points, int pointsPerSide, const sf::Vector2f &center, const sf::Vector2f &halfDims) {
+		sf::Vector2f corners[4] = {
+			center + sf::Vector2f(-halfDims.x, -halfDims.y), center + sf::Vector2f(halfDims.x, -halfDims.y),
+			center + sf::Vector2f(halfDims.x, halfDims.y), center + sf::Vector2f(-halfDims.x, halfDims.y)
+		};
+
+		points.clear();
+
+		for (int side = 0; side < 4; side++)
+		for (int i = 0; i < pointsPerSide; i++)
+			points.push_back(corners[side] + (corners[(side + 1) % 4] - corners[side]) * (static_cast<float>(i) / pointsPerSide));
+
+		if (randomInt(0, 1) == 0)
+			std::reverse(points.begin(), points.end());
+	}
+
+	// Boundaries of a point light, searched if minSearchPoints allows it
+	void getPointBoundaries(const std::vector<sf::Vector2f> &points, const std::vector<sf::Vector2f> &normals, bool convex, const sf::Vector2f &sourceCenter, float sourceRadius, int minSearchPoints,
+		std::vector<int> &bothEdgesIndices, std::vector<bool> &bothEdgesWindings, std::vector<int> &oneEdgeIndices, std::vector<bool> &oneEdgeWindings)
+	{
+		ShapePointsSoA pointsSoA;
+
+		pointsSoA.assign(points, normals);
+
+		std::vector<unsigned char> facing(points.size());
+
+		classifyFacingPoint(pointsSoA, 0, points.size(), sourceCenter, sourceRadius, facing.data());
+
+		auto getFacing = [&](int i, bool &frontBothEdges, bool &frontOneEdge) {
+			frontBothEdges = (facing[i] & FacingBothEdges) != 0;
+			frontOneEdge = (facing[i] & FacingOneEdge) != 0;
+		};
+
+		getFacingBoundaries(points, normals, convex, sourceRadius, minSearchPoints, getFacing, getFacing, [&](const sf::Vector2f &p) { return sourceCenter - p; },
+			bothEdgesIndices, bothEdgesWindings, oneEdgeIndices, oneEdgeWindings);
+	}
+
+	int numCases = 0;
+	int numNotConvexCases = 0;
+	int numOneRunCases = 0;
+	int numMismatches = 0;
+
+	void check(const std::vector<sf::Vector2f> &points, const sf::Vector2f &sourceCenter, float sourceRadius, const char* name) {
+		std::vector<sf::Vector2f> normals;
+
+		getNormals(points, normals);
+
+		// Like LightShape, so degenerate polygons are only searched if they would be in a LightShape
+		bool convex = isPolygonConvex(points);
+
+		if (!convex)
+			numNotConvexCases++;
+
+		std::vector<int> searchBothEdgesIndices, searchOneEdgeIndices, scanBothEdgesIndices, scanOneEdgeIndices;
+		std::vector<bool> searchBothEdgesWindings, searchOneEdgeWindings, scanBothEdgesWindings, scanOneEdgeWindings;
+
+		// Forced low, so every shape is searched
+		getPointBoundaries(points, normals, convex, sourceCenter, sourceRadius, 3, searchBothEdgesIndices, searchBothEdgesWindings, searchOneEdgeIndices, searchOneEdgeWindings);
+
+		// Never searched
+		getPointBoundaries(points, normals, convex, sourceCenter, sourceRadius, points.size() + 1, scanBothEdgesIndices, scanBothEdgesWindings, scanOneEdgeIndices, scanOneEdgeWindings);
+
+		numCases++;
+
+		if (scanBothEdgesIndices.size() == 2 && scanOneEdgeIndices.size() == 2)
+			numOneRunCases++;
+
+		if (searchBothEdgesIndices != scanBothEdgesIndices || searchBothEdgesWindings != scanBothEdgesWindings
+			|| searchOneEdgeIndices != scanOneEdgeIndices || searchOneEdgeWindings != scanOneEdgeWindings)
+		{
+			if (numMismatches < 10)
+				std::cerr << "Mismatch (" << name << ", " << points.size() << " points, source at " << sourceCenter.x << ", " << sourceCenter.y << " radius " << sourceRadius << ")" << std::endl;
+
+			numMismatches++;
+		}
+	}
+}
+
+int main() {
+	std::vector<sf::Vector2f> points;
+
+	for (int t = 0; t < 4000; t++) {
+		sf::Vector2f center(randomRange(-500.0f, 500.0f), randomRange(-500.0f, 500.0f));
+		sf::Vector2f radii(randomRange(1.0f, 100.0f), randomRange(1.0f, 100.0f));
+
+		getEllipse(points, randomInt(3, 300), center, radii, t % 2 == 0);
+
+		float maxRadius = std::max(radii.x, radii.y);
+
+		// Outside, near, inside and containing the shape
+		check(points, center + sf::Vector2f(randomRange(-1000.0f, 1000.0f), randomRange(-1000.0f, 1000.0f)), randomRange(0.1f, 50.0f), "convex");
+		check(points, center + vectorNormalize(sf::Vector2f(randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f))) * maxRadius * randomRange(1.0f, 1.5f), randomRange(0.1f, maxRadius), "convex, near");
+		check(points, center + sf::Vector2f(randomRange(-0.5f, 0.5f) * radii.x, randomRange(-0.5f, 0.5f) * radii.y), randomRange(0.1f, 50.0f), "convex, light inside");
+		check(points, center + sf::Vector2f(randomRange(-10.0f, 10.0f), randomRange(-10.0f, 10.0f)), maxRadius * randomRange(2.0f, 4.0f), "convex, light around");
+
+		// On a point, and on the line of an edge
+		int i = randomInt(0, points.size() - 1);
+
+		check(points, points[i], randomRange(0.1f, 10.0f), "convex, light on a point");
+		check(points, points[i] + (points[i] - points[(i + 1) % points.size()]) * randomRange(1.0f, 10.0f), randomRange(0.1f, 10.0f), "convex, light on an edge line");
+	}
+
+	for (int t = 0; t < 2000; t++) {
+		sf::Vector2f center(randomRange(-500.0f, 500.0f), randomRange(-500.0f, 500.0f));
+		sf::Vector2f source = center + sf::Vector2f(randomRange(-300.0f, 300.0f), randomRange(-300.0f, 300.0f));
+
+		// Slivers, tiny shapes, triangles and collinear points
+		getEllipse(points, randomInt(3, 300), center, sf::Vector2f(randomRange(10.0f, 100.0f), randomRange(0.001f, 0.1f)), t % 2 == 0);
+		check(points, source, randomRange(0.1f, 20.0f), "sliver");
+
+		getEllipse(points, randomInt(3, 300), center, sf::Vector2f(randomRange(0.001f, 0.01f), randomRange(0.001f, 0.01f)), true);
+		check(points, source, randomRange(0.1f, 20.0f), "tiny");
+
+		getEllipse(points, 3, center, sf::Vector2f(randomRange(1.0f, 100.0f), randomRange(1.0f, 100.0f)), false);
+		check(points, source, randomRange(0.1f, 20.0f), "triangle");
+
+		getSubdividedRectangle(points, randomInt(1, 80), center, sf::Vector2f(randomRange(1.0f, 100.0f), randomRange(1.0f, 100.0f)));
+		check(points, source, randomRange(0.1f, 20.0f), "collinear");
+
+		// Source on the line of a side
+		check(points, sf::Vector2f(points[0].x, source.y), randomRange(0.1f, 20.0f), "collinear, light on a side line");
+	}
+
+	std::cout << numCases << " cases, " << numNotConvexCases << " not convex, " << numOneRunCases << " with one run of facing edges, " << numMismatches << " mismatches" << std::endl;
+
+	return numMismatches == 0 ? 0 : 1;
+}